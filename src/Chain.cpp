@@ -0,0 +1,1008 @@
+
+#include "Chain.h"
+#include "misc_v10.h"
+#include "probability_v10.h"
+#include "Checkpoint.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <chrono>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+
+// identifies checkpoint files, and their format version
+static const char CHECKPOINT_MAGIC[8] = {'M', 'K', 'V', 'C', 'K', 'P', 'T', '8'};
+
+// maximum lag of the running autocorrelation of each parameter
+static const int ACF_MAX_LAG = 20;
+
+//------------------------------------------------
+// initialise chain
+void Chain::init(System &s, double * loglike_out, double * logprior_out,
+                 vector<double *> theta_out) {
+  
+  // pointer to system object
+  this->s_ptr = &s;
+  
+  // output buffers
+  this->loglike_out = loglike_out;
+  this->logprior_out = logprior_out;
+  this->theta_out = theta_out;
+  
+  // local copies of some parameters for convenience
+  d = s_ptr->d;
+  rungs = s_ptr->rungs;
+  rung_threads = s_ptr->rung_threads;
+  beta_vec = s_ptr->beta_vec;
+  
+  // random number streams are derived from the user-defined seed. Each chain
+  // is separated by a long jump, and each rung within a chain by a jump, with
+  // a final stream reserved for Metropolis coupling
+  RNG stream(s_ptr->seed);
+  for (int c = 1; c < s_ptr->chain; ++c) {
+    stream.long_jump();
+  }
+  
+  // initialise vector of particles
+  particle_vec = vector<Particle>(rungs);
+  for (int r = 0; r < rungs; ++r) {
+    particle_vec[r].init(s, stream);
+    stream.jump();
+  }
+  rng = stream;
+  
+  // evaluation counts and timings
+#ifdef MARKOVID_PROFILE
+  profile.init(d);
+#endif
+  
+  // specify rung order
+  rung_order = seq_int(0, rungs-1);
+  
+  // initialise adaptive ladder from the user-defined beta values
+  beta_log_gap = vector<double>(rungs - 1);
+  for (int i = 0; i < (rungs - 1); ++i) {
+    beta_log_gap[i] = log(beta_vec[i+1] - beta_vec[i]);
+  }
+  ladder_index = 1;
+  ladder_stepsize = 1.0;
+  
+  // specify stored values at first iteration. Ensures that user-defined initial
+  // values are the first stored values
+  buffer_rows = s_ptr->output_block_rows;
+  buffer_start = 0;
+  buffer_n = 0;
+  output_offset = -1;
+  rows_burnin = 0;
+  rows_sampling = 0;
+  rows_offset = -1;
+  store(0);
+  
+  // store Metropolis coupling acceptance rates
+  mc_accept_burnin = vector<int>(rungs - 1);
+  mc_accept_sampling = vector<int>(rungs - 1);
+  
+  // acceptance rates and run times
+  accept_rate_burnin = 0;
+  accept_rate_sampling = 0;
+  screen_count = vector<int>(rungs);
+  screen_pass = vector<int>(rungs);
+  screen_pass_burnin = vector<double>(rungs, numeric_limits<double>::quiet_NaN());
+  screen_pass_sampling = screen_pass_burnin;
+  screen_speedup_burnin = screen_pass_burnin;
+  screen_speedup_sampling = screen_pass_burnin;
+  time_burnin = 0;
+  time_sampling = 0;
+  
+  // running loglikelihood at each ladder position over sampling, in batches
+  // of the square root of the number of samples
+  int batch_size = max(1, int(sqrt(double(s_ptr->samples))));
+  rung_loglike = vector<BatchMeans>(rungs, BatchMeans(batch_size));
+  param_stats = vector<BatchMeans>(d, BatchMeans(batch_size));
+  param_acf = vector<Autocorrelation>(d, Autocorrelation(ACF_MAX_LAG));
+  
+  // progress through phases
+  burnin_done = 1;
+  sampling_done = 0;
+  burnin_end = s_ptr->burnin;
+  
+  // convergence history starts from the initial values
+  n_converge_col = 1 + int(s_ptr->free_param.size());
+  converge_history.clear();
+  if (s_ptr->converge_test) {
+    record_convergence();
+  }
+  group_interrupted = false;
+}
+
+//------------------------------------------------
+// run burn-in phase
+void Chain::run_burnin(Progress *progress, int task) {
+  
+  // return if burn-in was already completed before a checkpoint
+  if (burnin_done == burnin_end) {
+    return;
+  }
+  
+  // start timer
+  chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+  
+  // loop through burn-in iterations
+  for (int rep = burnin_done; rep < s_ptr->burnin; ++rep) {
+    
+    // update particles
+    update_rungs();
+    share_rungs(progress);
+    
+    // the running covariance of block proposals is restarted halfway through
+    // burn-in, so that early transient behaviour is forgotten
+    if ((s_ptr->block_update || s_ptr->hmc_update) && (rep == s_ptr->burnin / 2)) {
+      for (int r = 0; r < rungs; ++r) {
+        particle_vec[r].reset_block_cov();
+      }
+    }
+    
+    // store results
+    if ((rep % s_ptr->thin) == 0) {
+      store(rep / s_ptr->thin);
+    }
+    
+    // perform Metropolis coupling
+    PROFILE_START(t_coupling);
+    coupling(mc_accept_burnin, true);
+    PROFILE_STOP(profile, PROFILE_COUPLING, t_coupling);
+    
+    // update progress
+    if (progress) {
+      PROFILE_START(t_progress);
+      progress->update(task, rep + 1);
+      PROFILE_STOP(profile, PROFILE_PROGRESS, t_progress);
+    }
+    
+    // test for convergence, ending burn-in early if the test passes. The
+    // progress bar is completed as if all iterations had been run
+    burnin_done = rep + 1;
+    if (s_ptr->converge_test) {
+      if ((rep % s_ptr->converge_thin) == 0) {
+        record_convergence();
+      }
+      if ((burnin_done < s_ptr->burnin) && ((burnin_done % s_ptr->converge_interval) == 0) &&
+          test_convergence()) {
+        burnin_end = burnin_done;
+        if (progress) {
+          progress->update(task, s_ptr->burnin);
+        }
+        break;
+      }
+    }
+    
+    // write checkpoint, including when stopping early after an interrupt. The
+    // final checkpoint is written below, once phase summaries are complete
+    bool interrupt = is_interrupted(progress) && (burnin_done < s_ptr->burnin);
+    if (!s_ptr->checkpoint_file.empty() && (burnin_done < s_ptr->burnin) &&
+        (((burnin_done % s_ptr->checkpoint_interval) == 0) || interrupt)) {
+      chrono::duration<double> time_span = chrono::steady_clock::now() - t0;
+      time_burnin += time_span.count();
+      t0 = chrono::steady_clock::now();
+      save_checkpoint();
+    }
+    if (interrupt) {
+      return;
+    }
+    
+  }  // end burn-in MCMC loop
+  
+  // store acceptance rate of cold rung
+  accept_rate_burnin = particle_vec[rung_order[rungs-1]].accept_count / double(burnin_end*s_ptr->n_update);
+  get_screen_rates(screen_pass_burnin, screen_speedup_burnin);
+  converge_history.clear();
+  
+  // store run time
+  chrono::duration<double> time_span = chrono::steady_clock::now() - t0;
+  time_burnin += time_span.count();
+  
+  // streamed burn-in output is written out in full, so that sampling starts a
+  // new block at stored iteration n_store_burnin, and the burn-in length is
+  // recorded in the file. Within a group only the root writes to file
+  if (!s_ptr->output_file.empty()) {
+    flush_output();
+    buffer_start = s_ptr->n_store_burnin;
+    if (!group || group->is_root()) {
+      open_output();
+      output_file.set_burnin(burnin_end);
+    }
+  }
+  
+  // write checkpoint at end of phase
+  if (!s_ptr->checkpoint_file.empty()) {
+    save_checkpoint();
+  }
+  
+}
+
+//------------------------------------------------
+// run sampling phase
+void Chain::run_sampling(Progress *progress, int task) {
+  
+  // return if sampling was already completed before a checkpoint
+  if (sampling_done == s_ptr->samples) {
+    return;
+  }
+  
+  // start timer
+  chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+  
+  // reset acceptance and screening counts of all rungs, and fix block
+  // proposals
+  if (sampling_done == 0) {
+    for (int r = 0; r < rungs; ++r) {
+      particle_vec[r].accept_count = 0;
+      particle_vec[r].adapt_blocks = false;
+    }
+    fill(screen_count.begin(), screen_count.end(), 0);
+    fill(screen_pass.begin(), screen_pass.end(), 0);
+  }
+  
+  // loop through sampling iterations
+  for (int rep = sampling_done; rep < s_ptr->samples; ++rep) {
+    
+    // update particles
+    update_rungs();
+    share_rungs(progress);
+    
+    // store results
+    if ((rep % s_ptr->thin) == 0) {
+      store(s_ptr->n_store_burnin + rep / s_ptr->thin);
+    }
+    
+    // accumulate loglikelihoods for thermodynamic integration. Every iteration
+    // counts, irrespective of thinning and of which rungs are stored
+    for (int r = 0; r < rungs; ++r) {
+      rung_loglike[r].push(particle_vec[rung_order[r]].loglike);
+    }
+    
+    // accumulate diagnostics of the cold rung, again over every iteration
+    Particle &cold = particle_vec[rung_order[rungs-1]];
+    for (int i = 0; i < d; ++i) {
+      param_stats[i].push(cold.theta[i]);
+      param_acf[i].push(cold.theta[i]);
+    }
+    
+    // perform Metropolis coupling
+    PROFILE_START(t_coupling);
+    coupling(mc_accept_sampling, false);
+    PROFILE_STOP(profile, PROFILE_COUPLING, t_coupling);
+    
+    // update progress
+    if (progress) {
+      PROFILE_START(t_progress);
+      progress->update(task, s_ptr->burnin + rep + 1);
+      PROFILE_STOP(profile, PROFILE_PROGRESS, t_progress);
+    }
+    
+    // write checkpoint, including when stopping early after an interrupt
+    sampling_done = rep + 1;
+    bool interrupt = is_interrupted(progress) && (sampling_done < s_ptr->samples);
+    if (!s_ptr->checkpoint_file.empty() && (sampling_done < s_ptr->samples) &&
+        (((sampling_done % s_ptr->checkpoint_interval) == 0) || interrupt)) {
+      chrono::duration<double> time_span = chrono::steady_clock::now() - t0;
+      time_sampling += time_span.count();
+      t0 = chrono::steady_clock::now();
+      save_checkpoint();
+    }
+    if (interrupt) {
+      return;
+    }
+    
+  }  // end sampling MCMC loop
+  
+  // store acceptance rate of cold rung
+  accept_rate_sampling = particle_vec[rung_order[rungs-1]].accept_count/double(s_ptr->samples*s_ptr->n_update);
+  get_screen_rates(screen_pass_sampling, screen_speedup_sampling);
+  
+  // store run time
+  chrono::duration<double> time_span = chrono::steady_clock::now() - t0;
+  time_sampling += time_span.count();
+  
+  // write any remaining streamed output
+  if (!s_ptr->output_file.empty()) {
+    flush_output();
+    if (output_file.is_open()) {
+      output_offset = output_file.sync();
+    }
+  }
+  
+  // write checkpoint at end of phase
+  if (!s_ptr->checkpoint_file.empty()) {
+    save_checkpoint();
+  }
+  
+}
+
+//------------------------------------------------
+// update all rungs once, collecting screening counts by ladder position.
+// Rungs do not interact between coupling steps, and so can be updated
+// concurrently. The implicit barrier at the end of the loop ensures all rungs
+// are complete before coupling
+void Chain::update_rungs() {
+  
+  // errors cannot propagate out of a parallel region, so are caught and
+  // re-thrown once all rungs have finished
+  string error_message;
+  
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(rung_threads) schedule(static) if(rung_threads > 1)
+#endif
+  for (int r = 0; r < rungs; ++r) {
+    if (group && !group->is_local(rung_order[r])) {
+      continue;
+    }
+    try {
+      Particle &p = particle_vec[rung_order[r]];
+      p.update(beta_vec[rung_order[r]], s_ptr->delayed_accept[r]);
+      screen_count[r] += p.screen_count;
+      screen_pass[r] += p.screen_pass;
+      p.screen_count = 0;
+      p.screen_pass = 0;
+    } catch (std::exception &e) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+      error_message = e.what();
+    }
+  }
+  
+  if (!error_message.empty()) {
+    throw runtime_error(error_message);
+  }
+}
+
+//------------------------------------------------
+// share updated rungs over the group. Beyond the loglikelihoods needed for
+// coupling, the complete state is shared of the particles at stored rungs, for
+// storing by the root, and of the cold rung, for testing convergence and
+// calculating acceptance rates
+void Chain::share_rungs(Progress *progress) {
+  if (!group) {
+    return;
+  }
+  vector<int> shared;
+  for (int j : s_ptr->store_rungs) {
+    shared.push_back(rung_order[j]);
+  }
+  if (!is_in_vector(rung_order[rungs-1], shared)) {
+    shared.push_back(rung_order[rungs-1]);
+  }
+  group_interrupted = progress && progress->is_interrupted();
+  group->share(particle_vec, shared, group_interrupted);
+}
+
+//------------------------------------------------
+// true once the run has been interrupted. Within a group the last agreed value
+// is used, so that every process stops at the same iteration
+bool Chain::is_interrupted(Progress *progress) {
+  if (group) {
+    return group_interrupted;
+  }
+  return progress && progress->is_interrupted();
+}
+
+//------------------------------------------------
+// write current values of stored rungs to stored iteration k. When streaming,
+// the buffer is written out as soon as it is full. Within a group only the
+// root stores values
+void Chain::store(int k) {
+  if (group && !group->is_root()) {
+    return;
+  }
+  int local = k - buffer_start;
+  for (int j = 0; j < int(s_ptr->store_rungs.size()); ++j) {
+    Particle &p = particle_vec[rung_order[s_ptr->store_rungs[j]]];
+    int row = j*buffer_rows + local;
+    loglike_out[row] = p.loglike;
+    logprior_out[row] = p.logprior;
+    for (int i = 0; i < d; ++i) {
+      theta_out[i][row] = p.theta[i];
+    }
+  }
+  buffer_n = local + 1;
+  if (!s_ptr->output_file.empty() && (buffer_n == buffer_rows)) {
+    flush_output();
+  }
+}
+
+//------------------------------------------------
+// path of this chain's output file
+string Chain::get_output_path() {
+  return s_ptr->output_file + "_chain" + to_string(s_ptr->chain) + ".samples";
+}
+
+//------------------------------------------------
+// open the output file if it is not already open. The file is created on first
+// use, or is re-opened at the last checkpoint when resuming
+void Chain::open_output() {
+  if (output_file.is_open()) {
+    return;
+  }
+  if (output_offset < 0) {
+    output_file.create(*s_ptr, get_output_path(), s_ptr->output_precision);
+  } else {
+    output_file.reopen(get_output_path(), s_ptr->output_precision, output_offset);
+  }
+}
+
+//------------------------------------------------
+// write buffered stored iterations to the output file as a single block, and
+// empty the buffer
+void Chain::flush_output() {
+  if (buffer_n == 0) {
+    return;
+  }
+  open_output();
+  vector<double *> columns = {logprior_out, loglike_out};
+  columns.insert(columns.end(), theta_out.begin(), theta_out.end());
+  output_file.write_block(buffer_start, buffer_n, int(s_ptr->store_rungs.size()), buffer_rows, columns);
+  buffer_start += buffer_n;
+  buffer_n = 0;
+}
+
+//------------------------------------------------
+// Metropolis-coupling over temperature rungs
+void Chain::coupling(vector<int> &mc_accept, bool adaptive) {
+  
+  // return if single rung
+  if (rungs == 1) {
+    return;
+  }
+  
+  // loop over rungs, starting with the hottest chain and moving to the cold
+  // chain. Each time propose a swap with the next rung up
+  for (int i = 1; i < rungs; ++i) {
+    
+    // define rungs of interest
+    int rung1 = rung_order[i-1];
+    int rung2 = rung_order[i];
+    
+    // get log-likelihoods and beta values of two chains in the comparison
+    double loglike1 = particle_vec[rung1].loglike;
+    double loglike2 = particle_vec[rung2].loglike;
+    
+    double beta1 = beta_vec[rung1];
+    double beta2 = beta_vec[rung2];
+    
+    // calculate acceptance ratio (still in log space)
+    double acceptance = (loglike2*beta1 + loglike1*beta2) - (loglike1*beta1 + loglike2*beta2);
+    
+    // accept or reject move
+    bool accept_move = (log(runif_0_1(rng)) < acceptance);
+    
+    // probability of swap, used for adaptation
+    double accept_prob = (acceptance > 0) ? 1.0 : exp(acceptance);
+    
+    // implement swap
+    if (accept_move) {
+      
+      // swap beta values
+      beta_vec[rung1] = beta2;
+      beta_vec[rung2] = beta1;
+      
+      // swap rung order
+      int tmp = rung_order[i-1];
+      rung_order[i-1] = rung_order[i];
+      rung_order[i] = tmp;
+      
+      // update acceptance rates
+      mc_accept[i-1]++;
+      
+    }
+    
+    // Robbins-Monro update of the gap between these two positions (on the log
+    // scale). Gaps grow when swaps are accepted more often than the target,
+    // and shrink otherwise. Using the swap probability rather than the
+    // accept/reject outcome reduces the noise in the update
+    if (adaptive && s_ptr->adapt_beta) {
+      beta_log_gap[i-1] += ladder_stepsize*(accept_prob - 0.234)/sqrt(ladder_index);
+    }
+    
+  }  // end loop over rungs
+  
+  // rebuild the ladder from the adapted gaps
+  if (adaptive && s_ptr->adapt_beta) {
+    
+    // the hottest and coldest rungs are held fixed at their initial values,
+    // and the gaps are rescaled to span the range between them, so that only
+    // the interior spacing of the ladder is adapted
+    double beta_min = beta_vec[rung_order[0]];
+    double beta_max = beta_vec[rung_order[rungs-1]];
+    double gap_sum = 0.0;
+    for (int i = 0; i < (rungs - 1); ++i) {
+      gap_sum += exp(beta_log_gap[i]);
+    }
+    double log_scale = log(beta_max - beta_min) - log(gap_sum);
+    vector<double> ladder(rungs);
+    ladder[0] = beta_min;
+    for (int i = 0; i < (rungs - 2); ++i) {
+      beta_log_gap[i] += log_scale;
+      ladder[i+1] = ladder[i] + exp(beta_log_gap[i]);
+    }
+    beta_log_gap[rungs-2] += log_scale;
+    ladder[rungs-1] = beta_max;
+    
+    // assign new values to the particles at each position
+    for (int i = 0; i < rungs; ++i) {
+      beta_vec[rung_order[i]] = ladder[i];
+    }
+    ladder_index++;
+  }
+  
+}
+
+//------------------------------------------------
+// beta values in ladder order, from hottest to coldest
+vector<double> Chain::get_beta_ladder() {
+  vector<double> ret(rungs);
+  for (int i = 0; i < rungs; ++i) {
+    ret[i] = beta_vec[rung_order[i]];
+  }
+  return ret;
+}
+
+//------------------------------------------------
+// log marginal likelihood by thermodynamic integration of the mean
+// loglikelihood over the temperature ladder, using the trapezoidal rule
+// between rungs. If the hottest rung lies above zero then the mean
+// loglikelihood is taken as constant below it, which biases the estimate
+// unless the hottest rung lies at or close to zero. The standard error
+// combines the batch-means standard errors of each rung, treating rungs as
+// independent. Both are NaN if there is only a single rung
+void Chain::get_marginal_likelihood(double &log_ml, double &log_ml_se) {
+  if (rungs == 1) {
+    log_ml = numeric_limits<double>::quiet_NaN();
+    log_ml_se = numeric_limits<double>::quiet_NaN();
+    return;
+  }
+  vector<double> ladder = get_beta_ladder();
+  log_ml = 0.0;
+  double var = 0.0;
+  for (int r = 0; r < rungs; ++r) {
+    
+    // weight of this rung in the trapezoidal rule
+    double w = 0.0;
+    if (r == 0) {
+      w += ladder[0];
+    } else {
+      w += 0.5*(ladder[r] - ladder[r-1]);
+    }
+    if (r < (rungs - 1)) {
+      w += 0.5*(ladder[r+1] - ladder[r]);
+    }
+    
+    log_ml += w*rung_loglike[r].get_mean();
+    double se = rung_loglike[r].get_se();
+    var += w*w*se*se;
+  }
+  log_ml_se = sqrt(var);
+}
+
+//------------------------------------------------
+// screen pass rate and estimated speedup of delayed acceptance at each ladder
+// position over the current phase. Each screened proposal evaluates the
+// surrogate, at a relative cost of screen_cost, and only those passing go on
+// to the exact likelihood
+void Chain::get_screen_rates(vector<double> &pass_rate, vector<double> &speedup) {
+  vector<int> count = screen_count;
+  vector<int> pass = screen_pass;
+  if (group) {
+    group->sum(count);
+    group->sum(pass);
+  }
+  for (int r = 0; r < rungs; ++r) {
+    pass_rate[r] = numeric_limits<double>::quiet_NaN();
+    speedup[r] = numeric_limits<double>::quiet_NaN();
+    if (count[r] > 0) {
+      pass_rate[r] = pass[r] / double(count[r]);
+      speedup[r] = 1.0 / (s_ptr->screen_cost + pass_rate[r]);
+    }
+  }
+}
+
+//------------------------------------------------
+// path of this chain's checkpoint file
+string Chain::get_checkpoint_path() {
+  return s_ptr->checkpoint_file + "_chain" + to_string(s_ptr->chain) + ".bin";
+}
+
+//------------------------------------------------
+// hash of the data and model settings that a checkpoint depends on, but which
+// are too large to record in full: the binomial and duration data, spline
+// nodes, priors, the starting temperature ladder and lookup table grid
+uint64_t Chain::get_fingerprint() {
+  Fingerprint f;
+  f.add(s_ptr->trans_numer);
+  f.add(s_ptr->trans_denom);
+  f.add(s_ptr->m_day);
+  f.add(s_ptr->m_day_count);
+  f.add(s_ptr->node_x);
+  f.add(s_ptr->theta_min);
+  f.add(s_ptr->theta_max);
+  f.add(s_ptr->trans_type);
+  f.add(s_ptr->skip_param);
+  f.add(s_ptr->beta_vec);
+  f.add(s_ptr->adapt_beta);
+  const LookupSpec &spec = s_ptr->lookup_ptr->spec;
+  f.add(spec.m_max);
+  f.add(spec.m_step);
+  f.add(spec.n_s);
+  f.add(spec.x_max);
+  f.add(spec.interp_m);
+  f.add(spec.interp_s);
+  return f.value;
+}
+
+//------------------------------------------------
+// path of the file holding this chain's in-memory output rows at checkpoints
+string Chain::get_rows_path() {
+  return s_ptr->checkpoint_file + "_chain" + to_string(s_ptr->chain) + ".rows";
+}
+
+//------------------------------------------------
+// append in-memory output rows stored since the last checkpoint to the rows
+// file, in double precision, and record the new size of the file. The file is
+// created on first use, or is re-opened at the last checkpoint when resuming
+void Chain::save_rows() {
+  if (group && !group->is_root()) {
+    return;
+  }
+  if (!rows_file.is_open()) {
+    if (rows_offset < 0) {
+      rows_file.create(*s_ptr, get_rows_path(), 8);
+    } else {
+      rows_file.reopen(get_rows_path(), 8, rows_offset);
+    }
+  }
+  
+  int n_store = int(s_ptr->store_rungs.size());
+  int n_burnin_rows = (burnin_done - 1) / s_ptr->thin + 1;
+  int n_sampling_rows = (sampling_done == 0) ? 0 : (sampling_done - 1) / s_ptr->thin + 1;
+  vector<double *> columns = {logprior_out, loglike_out};
+  columns.insert(columns.end(), theta_out.begin(), theta_out.end());
+  
+  // write the new rows of each phase as a block starting at its first stored
+  // iteration index
+  int k0[2] = {rows_burnin, s_ptr->n_store_burnin + rows_sampling};
+  int n_rows[2] = {n_burnin_rows - rows_burnin, n_sampling_rows - rows_sampling};
+  for (int b = 0; b < 2; ++b) {
+    if (n_rows[b] == 0) {
+      continue;
+    }
+    vector<double *> block = columns;
+    for (double * &col : block) {
+      col += k0[b];
+    }
+    rows_file.write_block(k0[b], n_rows[b], n_store, s_ptr->n_store_iter, block);
+  }
+  rows_burnin = n_burnin_rows;
+  rows_sampling = n_sampling_rows;
+  rows_offset = rows_file.sync();
+}
+
+//------------------------------------------------
+// write complete chain state to file. Along with the state of every particle
+// and of the ladder, the output rows stored so far are kept, so that a resumed
+// run returns exactly the same output as an uninterrupted one. Streamed output
+// is already on file, while in-memory output is appended to the rows file. The
+// header records settings that must match when resuming
+void Chain::save_checkpoint() {
+  
+  CheckpointWriter writer(get_checkpoint_path());
+  
+  // header
+  writer.write_array(CHECKPOINT_MAGIC, 8);
+  writer.write(s_ptr->chain);
+  writer.write(s_ptr->seed);
+  writer.write(d);
+  writer.write(rungs);
+  writer.write(s_ptr->burnin);
+  writer.write(s_ptr->thin);
+  writer.write(s_ptr->store_rungs);
+  writer.write(s_ptr->block_update);
+  writer.write(s_ptr->full_block);
+  writer.write(s_ptr->hmc_update);
+  writer.write(s_ptr->hmc_steps);
+  writer.write(vector<int>(s_ptr->delayed_accept.begin(), s_ptr->delayed_accept.end()));
+  writer.write(s_ptr->screen_stride);
+  writer.write(s_ptr->output_file);
+  writer.write(s_ptr->output_precision);
+  writer.write(s_ptr->converge_test);
+  writer.write(s_ptr->converge_interval);
+  writer.write(s_ptr->converge_alpha);
+  writer.write(get_fingerprint());
+  
+  // progress through phases
+  writer.write(burnin_done);
+  writer.write(sampling_done);
+  writer.write(burnin_end);
+  writer.write(converge_history);
+  
+  // chain state
+  writer.write(beta_vec);
+  writer.write(rung_order);
+  writer.write(beta_log_gap);
+  writer.write(ladder_index);
+  writer.write_array(rng.state, 4);
+  writer.write(mc_accept_burnin);
+  writer.write(mc_accept_sampling);
+  writer.write(accept_rate_burnin);
+  writer.write(accept_rate_sampling);
+  writer.write(screen_count);
+  writer.write(screen_pass);
+  writer.write(screen_pass_burnin);
+  writer.write(screen_pass_sampling);
+  writer.write(screen_speedup_burnin);
+  writer.write(screen_speedup_sampling);
+  writer.write(time_burnin);
+  writer.write(time_sampling);
+  for (int r = 0; r < rungs; ++r) {
+    particle_vec[r].save_state(writer);
+  }
+  for (int r = 0; r < rungs; ++r) {
+    rung_loglike[r].save_state(writer);
+  }
+  for (int i = 0; i < d; ++i) {
+    param_stats[i].save_state(writer);
+    param_acf[i].save_state(writer);
+  }
+  
+  // streamed output is written out up to the current iteration, and only the
+  // size of the output file is recorded
+  if (!s_ptr->output_file.empty()) {
+    flush_output();
+    if (output_file.is_open()) {
+      output_offset = output_file.sync();
+    }
+    writer.write(buffer_start);
+    writer.write(output_offset);
+    writer.commit();
+    return;
+  }
+  
+  // in-memory output rows stored since the last checkpoint are appended to the
+  // rows file, and only the size of that file is recorded
+  save_rows();
+  writer.write(rows_burnin);
+  writer.write(rows_sampling);
+  writer.write(rows_offset);
+  
+  writer.commit();
+}
+
+//------------------------------------------------
+// restore complete chain state from file. The chain must already have been
+// initialised. The number of sampling iterations may be larger than when the
+// checkpoint was written, in which case sampling continues from where it
+// stopped
+bool Chain::load_checkpoint() {
+  
+  string path = get_checkpoint_path();
+  if (!file_exists(path)) {
+    return false;
+  }
+  CheckpointReader reader(path);
+  
+  // header
+  char magic[8];
+  reader.read_array(magic, 8);
+  if (!equal(magic, magic + 8, CHECKPOINT_MAGIC)) {
+    throw runtime_error(path + " is not a checkpoint file of this version");
+  }
+  int chain, d_stored, rungs_stored, burnin, thin;
+  unsigned int seed;
+  bool block_update, full_block, hmc_update;
+  int hmc_steps, screen_stride;
+  vector<int> delayed_accept(rungs);
+  vector<int> store_rungs(s_ptr->store_rungs.size());
+  string output_file;
+  int output_precision, converge_interval;
+  bool converge_test;
+  double converge_alpha;
+  reader.read(chain);
+  reader.read(seed);
+  reader.read(d_stored);
+  reader.read(rungs_stored);
+  reader.read(burnin);
+  reader.read(thin);
+  reader.read(store_rungs);
+  reader.read(block_update);
+  reader.read(full_block);
+  reader.read(hmc_update);
+  reader.read(hmc_steps);
+  reader.read(delayed_accept);
+  reader.read(screen_stride);
+  reader.read(output_file);
+  reader.read(output_precision);
+  reader.read(converge_test);
+  reader.read(converge_interval);
+  reader.read(converge_alpha);
+  uint64_t fingerprint;
+  reader.read(fingerprint);
+  if ((chain != s_ptr->chain) || (seed != s_ptr->seed) || (d_stored != d) ||
+      (rungs_stored != rungs) || (burnin != s_ptr->burnin) || (thin != s_ptr->thin) ||
+      (store_rungs != s_ptr->store_rungs) || (block_update != s_ptr->block_update) ||
+      (full_block != s_ptr->full_block) || (hmc_update != s_ptr->hmc_update) ||
+      (hmc_steps != s_ptr->hmc_steps) ||
+      (delayed_accept != vector<int>(s_ptr->delayed_accept.begin(), s_ptr->delayed_accept.end())) ||
+      (screen_stride != s_ptr->screen_stride) || (output_file != s_ptr->output_file) ||
+      (output_precision != s_ptr->output_precision) || (converge_test != s_ptr->converge_test) ||
+      (converge_interval != s_ptr->converge_interval) || (converge_alpha != s_ptr->converge_alpha)) {
+    throw runtime_error("checkpoint file " + path + " was written with different MCMC settings");
+  }
+  if (fingerprint != get_fingerprint()) {
+    throw runtime_error("checkpoint file " + path + " was written with different data or priors");
+  }
+  
+  // progress through phases
+  reader.read(burnin_done);
+  reader.read(sampling_done);
+  reader.read(burnin_end);
+  int n_history;
+  reader.read(n_history);
+  converge_history.resize(n_history);
+  reader.read_array(converge_history.data(), n_history);
+  if (sampling_done > s_ptr->samples) {
+    throw runtime_error("checkpoint file " + path + " has more sampling iterations than requested");
+  }
+  
+  // chain state
+  reader.read(beta_vec);
+  reader.read(rung_order);
+  reader.read(beta_log_gap);
+  reader.read(ladder_index);
+  reader.read_array(rng.state, 4);
+  reader.read(mc_accept_burnin);
+  reader.read(mc_accept_sampling);
+  reader.read(accept_rate_burnin);
+  reader.read(accept_rate_sampling);
+  reader.read(screen_count);
+  reader.read(screen_pass);
+  reader.read(screen_pass_burnin);
+  reader.read(screen_pass_sampling);
+  reader.read(screen_speedup_burnin);
+  reader.read(screen_speedup_sampling);
+  reader.read(time_burnin);
+  reader.read(time_sampling);
+  for (int r = 0; r < rungs; ++r) {
+    particle_vec[r].load_state(reader);
+  }
+  for (int r = 0; r < rungs; ++r) {
+    rung_loglike[r].load_state(reader);
+  }
+  for (int i = 0; i < d; ++i) {
+    param_stats[i].load_state(reader);
+    param_acf[i].load_state(reader);
+  }
+  
+  // streamed output continues from the end of the file at the checkpoint
+  if (!s_ptr->output_file.empty()) {
+    reader.read(buffer_start);
+    reader.read(output_offset);
+    buffer_n = 0;
+    return true;
+  }
+  
+  // in-memory output rows stored so far are read back from the rows file,
+  // which is then continued from its size at the checkpoint
+  reader.read(rows_burnin);
+  reader.read(rows_sampling);
+  reader.read(rows_offset);
+  if (rows_offset >= 0) {
+    vector<double *> columns = {logprior_out, loglike_out};
+    columns.insert(columns.end(), theta_out.begin(), theta_out.end());
+    OutputFile::read_blocks(get_rows_path(), rows_offset, int(s_ptr->store_rungs.size()),
+                            s_ptr->n_store_iter, columns);
+  }
+  
+  return true;
+}
+
+//------------------------------------------------
+// append the loglikelihood and free parameters of the cold rung to the
+// convergence history
+void Chain::record_convergence() {
+  Particle &p = particle_vec[rung_order[rungs-1]];
+  converge_history.push_back(p.loglike);
+  for (int i : s_ptr->free_param) {
+    converge_history.push_back(p.theta[i]);
+  }
+}
+
+//------------------------------------------------
+// mean and variance of the mean of n values of x spaced stride apart. The
+// variance of the mean is estimated by batch means over sqrt(n) batches, which
+// accounts for autocorrelation. Also returns the sample variance
+static void batch_means(const double *x, int n, int stride, double &mean,
+                        double &var, double &var_mean) {
+  
+  int n_batch = int(sqrt(double(n)));
+  int batch_size = n / n_batch;
+  int n_used = n_batch*batch_size;
+  
+  mean = 0.0;
+  for (int t = 0; t < n_used; ++t) {
+    mean += x[t*stride];
+  }
+  mean /= n_used;
+  
+  var = 0.0;
+  var_mean = 0.0;
+  for (int b = 0; b < n_batch; ++b) {
+    double batch_mean = 0.0;
+    for (int t = b*batch_size; t < (b + 1)*batch_size; ++t) {
+      batch_mean += x[t*stride];
+      var += (x[t*stride] - mean)*(x[t*stride] - mean);
+    }
+    batch_mean /= batch_size;
+    var_mean += (batch_mean - mean)*(batch_mean - mean);
+  }
+  var /= (n_used - 1);
+  var_mean /= (n_batch - 1)*double(n_batch);
+}
+
+//------------------------------------------------
+// test the latter half of the convergence history. Every column must pass a
+// Geweke test comparing the first 10% and the last 50% of this window at level
+// s.converge_alpha, must have an effective sample size of at least 10, and
+// must have a split-Rhat below 1.1 between the two halves of the window. The
+// first half of the history is discarded as transient
+bool Chain::test_convergence() {
+  
+  int n_row = int(converge_history.size()) / n_converge_col;
+  int n_window = n_row - n_row / 2;
+  int n_a = n_window / 10;
+  int n_b = n_window / 2;
+  if (n_a < 10) {
+    return false;
+  }
+  const double *window = &converge_history[(n_row - n_window)*n_converge_col];
+  
+  for (int i = 0; i < n_converge_col; ++i) {
+    const double *x = window + i;
+    double mean_a, var_a, var_mean_a, mean_b, var_b, var_mean_b, mean_w, var_w, var_mean_w;
+    batch_means(x, n_a, n_converge_col, mean_a, var_a, var_mean_a);
+    batch_means(x + (n_window - n_b)*n_converge_col, n_b, n_converge_col, mean_b, var_b, var_mean_b);
+    batch_means(x, n_window, n_converge_col, mean_w, var_w, var_mean_w);
+    
+    // a column that has not moved cannot be tested
+    if (!(var_mean_a + var_mean_b > 0) || !(var_mean_w > 0)) {
+      return false;
+    }
+    
+    // effective sample size
+    if (var_w / var_mean_w < 10) {
+      return false;
+    }
+    
+    // Geweke two-sided p-value
+    double z = (mean_a - mean_b) / sqrt(var_mean_a + var_mean_b);
+    if (2*R::pnorm(-fabs(z), 0, 1, true, false) <= s_ptr->converge_alpha) {
+      return false;
+    }
+    
+    // split-Rhat
+    vector<Welford> halves(2);
+    int n_half = n_window / 2;
+    for (int t = 0; t < n_half; ++t) {
+      halves[0].push(x[t*n_converge_col]);
+      halves[1].push(x[(n_window - n_half + t)*n_converge_col]);
+    }
+    if (!(rhat(halves) < 1.1)) {
+      return false;
+    }
+  }
+  
+  return true;
+}
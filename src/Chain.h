@@ -0,0 +1,212 @@
+
+#pragma once
+
+#include "System.h"
+#include "Particle.h"
+#include "OutputFile.h"
+#include "Progress.h"
+#include "RungGroup.h"
+#include "OnlineStats.h"
+
+#include <vector>
+
+//------------------------------------------------
+// class defining a single MCMC chain, made up of one particle per temperature
+// rung. A chain holds all of its own state, and so different chains can be run
+// concurrently on different threads. Progress is reported through a Progress
+// object, and the only calls to R are those it makes when a chain happens to
+// be running on the main thread.
+class Chain {
+  
+public:
+  // PUBLIC OBJECTS
+  
+  // pointer to system object
+  System * s_ptr;
+  
+  // local copies of some parameters for convenience
+  int d;
+  int rungs;
+  int rung_threads;
+  
+  // thermodynamic powers and order of particles over rungs. beta_vec is
+  // indexed by particle, and rung_order gives the particle at each position
+  // in the temperature ladder, from hottest to coldest
+  std::vector<double> beta_vec;
+  std::vector<int> rung_order;
+  
+  // adaptive temperature ladder. The ladder is parameterised by the log of the
+  // gap in beta between adjacent positions, which is tuned by Robbins-Monro
+  // toward a target swap acceptance rate during burn-in. The gaps are
+  // rescaled after each update so that the hottest and coldest positions
+  // keep their initial values
+  std::vector<double> beta_log_gap;
+  int ladder_index;
+  double ladder_stepsize;
+  
+  // vector of particles
+  std::vector<Particle> particle_vec;
+  
+  // random number stream used for Metropolis coupling
+  RNG rng;
+  
+  // output buffers for stored loglikelihood, logprior and theta values. These
+  // are allocated by the caller and hold buffer_rows rows per stored rung.
+  // Rows are grouped by rung, and within each rung run over burn-in followed
+  // by sampling iterations. theta_out holds one column per parameter. When
+  // output is held in memory buffer_rows covers every stored iteration.
+  // Otherwise the buffer holds stored iterations from buffer_start onwards,
+  // and is written to the output file whenever it fills up
+  double * loglike_out;
+  double * logprior_out;
+  std::vector<double *> theta_out;
+  int buffer_rows;
+  int buffer_start;
+  int buffer_n;
+  
+  // streamed output file, and its size in bytes at the last checkpoint (or -1
+  // if the file is not yet created)
+  OutputFile output_file;
+  int64_t output_offset;
+  
+  // when output is held in memory, the rows stored so far are appended to a
+  // companion of the checkpoint file at each checkpoint. Records the number of
+  // burn-in and sampling rows already written, and the size of the file in
+  // bytes at the last checkpoint (or -1 if the file is not yet created)
+  OutputFile rows_file;
+  int rows_burnin;
+  int rows_sampling;
+  int64_t rows_offset;
+  
+  // Metropolis coupling acceptance rates
+  std::vector<int> mc_accept_burnin;
+  std::vector<int> mc_accept_sampling;
+  
+  // acceptance rate of the cold rung in each phase
+  double accept_rate_burnin;
+  double accept_rate_sampling;
+  
+  // delayed acceptance at each ladder position, from hottest to coldest.
+  // screen_count and screen_pass count screened proposals, and those passing
+  // the screen, over the current phase. At the end of each phase these give
+  // the pass rate of the screen, and the estimated speedup of the transition
+  // likelihood over screened proposals, as the ratio of ages evaluated
+  // without and with screening. Both are NaN at positions where nothing was
+  // screened
+  std::vector<int> screen_count;
+  std::vector<int> screen_pass;
+  std::vector<double> screen_pass_burnin;
+  std::vector<double> screen_pass_sampling;
+  std::vector<double> screen_speedup_burnin;
+  std::vector<double> screen_speedup_sampling;
+  
+  // run time of each phase in seconds
+  double time_burnin;
+  double time_sampling;
+  
+  // running mean and batch-means variance of the loglikelihood at each ladder
+  // position over every sampling iteration, from hottest to coldest, for
+  // estimating the marginal likelihood by thermodynamic integration
+  std::vector<BatchMeans> rung_loglike;
+  
+  // running summaries of each parameter of the cold rung over every sampling
+  // iteration, giving its effective sample size, its two halves for
+  // split-Rhat over chains, and its autocorrelation at short lags
+  std::vector<BatchMeans> param_stats;
+  std::vector<Autocorrelation> param_acf;
+  
+  // number of completed iterations of each phase, counting the initial values
+  // as the first burn-in iteration. burnin_end is the length of burn-in, which
+  // is shortened if the chain is found to have converged early
+  int burnin_done;
+  int sampling_done;
+  int burnin_end;
+  
+  // history of cold rung loglikelihood and free parameters during burn-in, used
+  // when testing convergence. Holds one row of n_converge_col values for every
+  // s.converge_thin-th iteration
+  std::vector<double> converge_history;
+  int n_converge_col;
+  
+  // processes sharing the rungs of this chain, or null if all rungs are
+  // updated by this process. group_interrupted records whether any process in
+  // the group was interrupted as of the last share
+  RungGroup * group;
+  bool group_interrupted;
+  
+  // evaluation counts and timings of chain-level components, when compiled
+  // with profiling. Particles hold their own counts
+#ifdef MARKOVID_PROFILE
+  Profile profile;
+#endif
+  
+  
+  // PUBLIC FUNCTIONS
+  
+  // constructors
+  Chain() : group(nullptr) {};
+  
+  // initialise. Output buffers must each hold s.output_block_rows values per
+  // stored rung, with one theta buffer per parameter
+  void init(System &s, double * loglike_out, double * logprior_out,
+            std::vector<double *> theta_out);
+  
+  // run MCMC phases, continuing from the last completed iteration. If progress
+  // is given then the completed iterations over both phases are reported as
+  // the given task after every iteration, and a phase stops early once the
+  // interrupted flag is raised, writing a checkpoint first if checkpointing
+  // is enabled
+  void run_burnin(Progress *progress = nullptr, int task = 0);
+  void run_sampling(Progress *progress = nullptr, int task = 0);
+  
+  // update all rungs once, and share updated rungs over the group if there is
+  // one
+  void update_rungs();
+  void share_rungs(Progress *progress);
+  
+  // true once the run has been interrupted, agreed over the group if there is
+  // one
+  bool is_interrupted(Progress *progress);
+  
+  // write current values of stored rungs to stored iteration k
+  void store(int k);
+  
+  // write buffered stored iterations to the output file
+  std::string get_output_path();
+  void open_output();
+  void flush_output();
+  
+  // record the current state of the cold rung, and test the recorded history
+  // for convergence
+  void record_convergence();
+  bool test_convergence();
+  
+  // Metropolis-coupling over temperature rungs
+  void coupling(std::vector<int> &mc_accept, bool adaptive);
+  
+  // screen pass rate and estimated speedup of delayed acceptance at each
+  // ladder position over the current phase, summed over the group if there
+  // is one
+  void get_screen_rates(std::vector<double> &pass_rate, std::vector<double> &speedup);
+  
+  // beta values in ladder order, from hottest to coldest
+  std::vector<double> get_beta_ladder();
+  
+  // log marginal likelihood by thermodynamic integration over the sampling
+  // phase, and its Monte Carlo standard error
+  void get_marginal_likelihood(double &log_ml, double &log_ml_se);
+  
+  // write complete chain state to this chain's checkpoint file, or restore it
+  // from that file. load_checkpoint() returns false if there is no file, and
+  // throws if the file was written with different settings, including data
+  // and priors summarised by get_fingerprint(). When
+  // output is held in memory, save_rows() appends newly stored rows to the
+  // companion rows file
+  std::string get_checkpoint_path();
+  uint64_t get_fingerprint();
+  std::string get_rows_path();
+  void save_rows();
+  void save_checkpoint();
+  bool load_checkpoint();
+  
+};
@@ -0,0 +1,78 @@
+
+#include "Checkpoint.h"
+
+#include <stdio.h>
+#include <stdexcept>
+
+using namespace std;
+
+//------------------------------------------------
+// fold n bytes into the hash
+void Fingerprint::add_bytes(const void *x, size_t n) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(x);
+  for (size_t i = 0; i < n; ++i) {
+    value ^= bytes[i];
+    value *= 1099511628211ULL;
+  }
+}
+
+//------------------------------------------------
+// open temporary file for writing
+CheckpointWriter::CheckpointWriter(const string &path) {
+  this->path = path;
+  tmp_path = path + ".tmp";
+  stream.open(tmp_path, ios::out | ios::binary | ios::trunc);
+  if (!stream) {
+    throw runtime_error("could not open checkpoint file " + tmp_path + " for writing");
+  }
+}
+
+//------------------------------------------------
+// close temporary file and rename over the previous checkpoint. Renaming
+// within a directory is atomic on POSIX systems
+void CheckpointWriter::commit() {
+  stream.close();
+  if (stream.fail()) {
+    remove(tmp_path.c_str());
+    throw runtime_error("failed writing checkpoint file " + tmp_path);
+  }
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    remove(tmp_path.c_str());
+    throw runtime_error("could not move checkpoint file into place at " + path);
+  }
+}
+
+//------------------------------------------------
+// open checkpoint file for reading
+CheckpointReader::CheckpointReader(const string &path) {
+  this->path = path;
+  stream.open(path, ios::in | ios::binary);
+  if (!stream) {
+    throw runtime_error("could not open checkpoint file " + path);
+  }
+}
+
+//------------------------------------------------
+// throw if the last read failed
+void CheckpointReader::check() {
+  if (!stream) {
+    throw runtime_error("checkpoint file " + path + " is truncated or corrupt");
+  }
+}
+
+//------------------------------------------------
+// read stored vector length and throw if it differs from n
+void CheckpointReader::check_length(int n) {
+  int n_stored;
+  read(n_stored);
+  if (n_stored != n) {
+    throw runtime_error("checkpoint file " + path + " does not match the current model");
+  }
+}
+
+//------------------------------------------------
+// return true if a file exists and can be opened for reading
+bool file_exists(const string &path) {
+  ifstream stream(path);
+  return stream.good();
+}
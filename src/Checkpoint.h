@@ -0,0 +1,178 @@
+
+#pragma once
+
+#include <stdint.h>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//------------------------------------------------
+// class for writing sampler state to a binary checkpoint file. Values are
+// written in native byte order, and so checkpoints can only be read back on
+// machines of the same architecture. The file is first written to a temporary
+// path and is then renamed into place by commit(), meaning an interrupted write
+// never replaces a good checkpoint. Errors are thrown as std::runtime_error,
+// as checkpoints may be written from worker threads.
+class CheckpointWriter {
+  
+public:
+  // PUBLIC OBJECTS
+  
+  std::string path;
+  std::string tmp_path;
+  std::ofstream stream;
+  
+  
+  // PUBLIC FUNCTIONS
+  
+  // constructors
+  CheckpointWriter(const std::string &path);
+  
+  // write single value
+  template<class TYPE>
+  void write(const TYPE &x) {
+    stream.write(reinterpret_cast<const char *>(&x), sizeof(TYPE));
+  }
+  
+  // write contiguous array of values
+  template<class TYPE>
+  void write_array(const TYPE *x, int n) {
+    stream.write(reinterpret_cast<const char *>(x), n*sizeof(TYPE));
+  }
+  
+  // write vectors, preceded by their length
+  template<class TYPE>
+  void write(const std::vector<TYPE> &x) {
+    write(int(x.size()));
+    write_array(x.data(), int(x.size()));
+  }
+  template<class TYPE>
+  void write(const std::vector<std::vector<TYPE>> &x) {
+    write(int(x.size()));
+    for (unsigned int i = 0; i < x.size(); ++i) {
+      write(x[i]);
+    }
+  }
+  
+  // write string, preceded by its length
+  void write(const std::string &x) {
+    write(int(x.size()));
+    write_array(x.data(), int(x.size()));
+  }
+  
+  // flush to disk and move into place
+  void commit();
+  
+};
+
+//------------------------------------------------
+// class for reading sampler state back from a checkpoint file written by
+// CheckpointWriter. Reads mirror writes exactly, and a truncated file or a
+// vector of unexpected length throws std::runtime_error
+class CheckpointReader {
+  
+public:
+  // PUBLIC OBJECTS
+  
+  std::string path;
+  std::ifstream stream;
+  
+  
+  // PUBLIC FUNCTIONS
+  
+  // constructors
+  CheckpointReader(const std::string &path);
+  
+  // read single value
+  template<class TYPE>
+  void read(TYPE &x) {
+    stream.read(reinterpret_cast<char *>(&x), sizeof(TYPE));
+    check();
+  }
+  
+  // read contiguous array of values
+  template<class TYPE>
+  void read_array(TYPE *x, int n) {
+    stream.read(reinterpret_cast<char *>(x), n*sizeof(TYPE));
+    check();
+  }
+  
+  // read vectors into existing storage, which must already be the right size
+  template<class TYPE>
+  void read(std::vector<TYPE> &x) {
+    check_length(int(x.size()));
+    read_array(x.data(), int(x.size()));
+  }
+  template<class TYPE>
+  void read(std::vector<std::vector<TYPE>> &x) {
+    check_length(int(x.size()));
+    for (unsigned int i = 0; i < x.size(); ++i) {
+      read(x[i]);
+    }
+  }
+  
+  // read string of any stored length
+  void read(std::string &x) {
+    int n;
+    read(n);
+    if (n < 0) {
+      throw std::runtime_error("checkpoint file " + path + " is truncated or corrupt");
+    }
+    x.resize(n);
+    read_array(&x[0], n);
+  }
+  
+  // throw if the last read failed, or if the next stored length differs from n
+  void check();
+  void check_length(int n);
+  
+};
+
+//------------------------------------------------
+// class for accumulating a 64-bit FNV-1a hash over the raw bytes of values.
+// Used to fingerprint the data and model settings behind a checkpoint, which
+// are too large to store in full
+class Fingerprint {
+  
+public:
+  // PUBLIC OBJECTS
+  
+  uint64_t value;
+  
+  
+  // PUBLIC FUNCTIONS
+  
+  // constructors
+  Fingerprint() : value(14695981039346656037ULL) {};
+  
+  // add single value
+  template<class TYPE>
+  void add(const TYPE &x) {
+    add_bytes(&x, sizeof(TYPE));
+  }
+  
+  // add vectors, including their length
+  template<class TYPE>
+  void add(const std::vector<TYPE> &x) {
+    add(int(x.size()));
+    add_bytes(x.data(), x.size()*sizeof(TYPE));
+  }
+  template<class TYPE>
+  void add(const std::vector<std::vector<TYPE>> &x) {
+    add(int(x.size()));
+    for (unsigned int i = 0; i < x.size(); ++i) {
+      add(x[i]);
+    }
+  }
+  void add(const std::vector<bool> &x) {
+    add(std::vector<int>(x.begin(), x.end()));
+  }
+  
+  void add_bytes(const void *x, size_t n);
+  
+};
+
+//------------------------------------------------
+// return true if a file exists and can be opened for reading
+bool file_exists(const std::string &path);
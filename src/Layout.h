@@ -0,0 +1,183 @@
+
+#pragma once
+
+#include <math.h>
+
+//------------------------------------------------
+// transformations between a parameter theta in natural space and the
+// unconstrained phi in which proposals are made, with one specialisation per
+// transformation type (see main.R for a key to types). Every function takes
+// the bounds a and b of theta. adjustment() gives the log ratio of Jacobians
+// between a proposed and a current value, as needed by Metropolis-Hastings,
+// and phi_grad() converts the derivative grad of the log target with respect
+// to theta into the derivative with respect to phi, including the log
+// Jacobian, which is added to log_jacobian
+template<int TYPE>
+struct Transform;
+
+// [-Inf,Inf] -> phi = theta
+template<>
+struct Transform<0> {
+  static double to_theta(double phi, double /*a*/, double /*b*/) {
+    return phi;
+  }
+  static double to_phi(double theta, double /*a*/, double /*b*/) {
+    return theta;
+  }
+  static double adjustment(double /*theta_prop*/, double /*theta*/, double /*a*/, double /*b*/) {
+    return 0.0;
+  }
+  static double phi_grad(double /*theta*/, double grad, double /*a*/, double /*b*/, double &/*log_jacobian*/) {
+    return grad;
+  }
+};
+
+// [-Inf,b] -> phi = log(b - theta)
+template<>
+struct Transform<1> {
+  static double to_theta(double phi, double /*a*/, double b) {
+    return b - exp(phi);
+  }
+  static double to_phi(double theta, double /*a*/, double b) {
+    return log(b - theta);
+  }
+  static double adjustment(double theta_prop, double theta, double /*a*/, double b) {
+    return log(b - theta_prop) - log(b - theta);
+  }
+  static double phi_grad(double theta, double grad, double /*a*/, double b, double &log_jacobian) {
+    log_jacobian += log(b - theta);
+    return grad*(theta - b) + 1;
+  }
+};
+
+// [a,Inf] -> phi = log(theta - a)
+template<>
+struct Transform<2> {
+  static double to_theta(double phi, double a, double /*b*/) {
+    return exp(phi) + a;
+  }
+  static double to_phi(double theta, double a, double /*b*/) {
+    return log(theta - a);
+  }
+  static double adjustment(double theta_prop, double theta, double a, double /*b*/) {
+    return log(theta_prop - a) - log(theta - a);
+  }
+  static double phi_grad(double theta, double grad, double a, double /*b*/, double &log_jacobian) {
+    log_jacobian += log(theta - a);
+    return grad*(theta - a) + 1;
+  }
+};
+
+// [a,b] -> phi = log((theta - a)/(b - theta))
+template<>
+struct Transform<3> {
+  static double to_theta(double phi, double a, double b) {
+    return (b*exp(phi) + a) / (1 + exp(phi));
+  }
+  static double to_phi(double theta, double a, double b) {
+    return log(theta - a) - log(b - theta);
+  }
+  static double adjustment(double theta_prop, double theta, double a, double b) {
+    return log(b - theta_prop) + log(theta_prop - a) - log(b - theta) - log(theta - a);
+  }
+  static double phi_grad(double theta, double grad, double a, double b, double &log_jacobian) {
+    double range = b - a;
+    double lower = theta - a;
+    double upper = b - theta;
+    log_jacobian += log(lower) + log(upper) - log(range);
+    return grad*lower*upper/range + (upper - lower)/range;
+  }
+};
+
+//------------------------------------------------
+// transformation of a single parameter, resolved from its type once when the
+// model is loaded, so that proposals call the matching specialisation of
+// Transform directly rather than switching on the type every time. The
+// bounds of the parameter are stored alongside
+struct ParamTransform {
+  
+  double a;
+  double b;
+  double (*to_theta_fn)(double, double, double);
+  double (*to_phi_fn)(double, double, double);
+  double (*adjustment_fn)(double, double, double, double);
+  double (*phi_grad_fn)(double, double, double, double, double &);
+  
+  // resolve the specialisation of the given type
+  template<int TYPE>
+  static ParamTransform make(double a, double b) {
+    return {a, b, &Transform<TYPE>::to_theta, &Transform<TYPE>::to_phi,
+            &Transform<TYPE>::adjustment, &Transform<TYPE>::phi_grad};
+  }
+  
+  double to_theta(double phi) const {
+    return to_theta_fn(phi, a, b);
+  }
+  double to_phi(double theta) const {
+    return to_phi_fn(theta, a, b);
+  }
+  double adjustment(double theta_prop, double theta) const {
+    return adjustment_fn(theta_prop, theta, a, b);
+  }
+  double phi_grad(double theta, double grad, double &log_jacobian) const {
+    return phi_grad_fn(theta, grad, a, b, log_jacobian);
+  }
+};
+
+//------------------------------------------------
+// spline values over n_age ages from n_node node values, through a basis
+// matrix stored in column-major order (n_age rows, n_node columns). The
+// general version accumulates one column of the basis at a time. The
+// specialisations for a fixed number of nodes N instead find each age in a
+// single pass, with the loop over nodes unrolled at compile time, summing
+// nodes in the same order so that results are identical. The version used is
+// resolved once when the model is loaded
+typedef void (*SplineKernel)(const double *basis, const double *node, int n_node,
+                             int n_age, double *spline);
+
+inline void spline_kernel(const double *basis, const double *node, int n_node,
+                          int n_age, double *spline) {
+  for (int i = 0; i < n_age; ++i) {
+    spline[i] = 0.0;
+  }
+  for (int j = 0; j < n_node; ++j) {
+    const double *col = basis + j*n_age;
+    for (int i = 0; i < n_age; ++i) {
+      spline[i] += col[i]*node[j];
+    }
+  }
+}
+
+template<int N>
+void spline_kernel_fixed(const double *basis, const double *node, int /*n_node*/,
+                         int n_age, double *spline) {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for (int i = 0; i < n_age; ++i) {
+    double x = 0.0;
+    for (int j = 0; j < N; ++j) {
+      x += basis[j*n_age + i]*node[j];
+    }
+    spline[i] = x;
+  }
+}
+
+// specialised kernel for n_node nodes, or the general kernel if n_node is
+// outside the range of specialisations
+inline SplineKernel get_spline_kernel(int n_node) {
+  switch(n_node) {
+  case 2: return &spline_kernel_fixed<2>;
+  case 3: return &spline_kernel_fixed<3>;
+  case 4: return &spline_kernel_fixed<4>;
+  case 5: return &spline_kernel_fixed<5>;
+  case 6: return &spline_kernel_fixed<6>;
+  case 7: return &spline_kernel_fixed<7>;
+  case 8: return &spline_kernel_fixed<8>;
+  case 9: return &spline_kernel_fixed<9>;
+  case 10: return &spline_kernel_fixed<10>;
+  case 11: return &spline_kernel_fixed<11>;
+  case 12: return &spline_kernel_fixed<12>;
+  default: return &spline_kernel;
+  }
+}
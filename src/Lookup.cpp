@@ -0,0 +1,311 @@
+
+#include "Lookup.h"
+#include "misc_v10.h"
+
+#include <math.h>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+using namespace std;
+
+//------------------------------------------------
+// lexicographic ordering over all fields of the specification
+bool LookupSpec::operator<(const LookupSpec &other) const {
+  return tie(m_max, m_step, n_s, x_max, interp_m, interp_s) <
+    tie(other.m_max, other.m_step, other.n_s, other.x_max, other.interp_m, other.interp_s);
+}
+
+//------------------------------------------------
+// build lookup table from grid specification. The density on day x is the
+// probability of the Erlang distribution falling in [x, x+1), buffered by a
+// tiny value against underflow
+void Lookup::init(const LookupSpec &spec) {
+  
+  // define grid
+  this->spec = spec;
+  n_m = int(round(spec.m_max / spec.m_step)) + 1;
+  m_step = spec.m_step;
+  m_scale = 1.0 / m_step;
+  n_s = spec.n_s;
+  n_x = spec.x_max + 1;
+  log_density_min = log(1e-200);
+  log_density = vector<double>(n_m*n_s*n_x);
+  
+  // populate table, calculating each cumulative probability only once
+  vector<double> cdf(n_x + 1);
+  for (int i = 0; i < n_m; ++i) {
+    double m = i*m_step;
+    for (int j = 0; j < n_s; ++j) {
+      double shape = j + 1;
+      double *row = &log_density[(i*n_s + j)*n_x];
+      
+      // zero mean has zero density everywhere
+      if (m == 0) {
+        fill(row, row + n_x, log_density_min);
+        continue;
+      }
+      
+      for (int x = 0; x <= n_x; ++x) {
+        cdf[x] = R::pgamma(x, shape, m/shape, true, false);
+      }
+      for (int x = 0; x < n_x; ++x) {
+        row[x] = log(max(cdf[x+1] - cdf[x], 0.0) + 1e-200);
+      }
+    }
+  }
+  
+}
+
+//------------------------------------------------
+// find the grid cell containing (m, s). When interpolating, the last grid
+// point is reached with weight 1 on the upper neighbour of the cell below it
+bool Lookup::get_cell(double m, double s, int &m_index, int &s_index,
+                      double &m_weight, double &s_weight) const {
+  
+  // mean dimension
+  double m_pos = m * m_scale;
+  if (!(m_pos >= 0)) {
+    return false;
+  }
+  if (spec.interp_m && (n_m > 1)) {
+    if (m_pos > n_m - 1) {
+      return false;
+    }
+    m_index = min(int(m_pos), n_m - 2);
+    m_weight = m_pos - m_index;
+  } else {
+    if (m_pos >= n_m) {
+      return false;
+    }
+    m_index = int(m_pos);
+    m_weight = 0.0;
+  }
+  
+  // shape dimension
+  if (!(s >= 0)) {
+    return false;
+  }
+  if (spec.interp_s && (n_s > 1)) {
+    if (s > n_s - 1) {
+      return false;
+    }
+    s_index = min(int(s), n_s - 2);
+    s_weight = s - s_index;
+  } else {
+    if (s >= n_s) {
+      return false;
+    }
+    s_index = int(s);
+    s_weight = 0.0;
+  }
+  
+  return true;
+}
+
+//------------------------------------------------
+// get log-density of delay distribution on day x, from the table where
+// possible and exactly otherwise
+double Lookup::get_log_density(int x, double m, double s) const {
+  if (x < 0) {
+    return log_density_min;
+  }
+  int m_index, s_index;
+  double m_weight, s_weight;
+  if ((x >= n_x) || !get_cell(m, s, m_index, s_index, m_weight, s_weight)) {
+    return get_log_density_exact(x, m, s);
+  }
+  int m_upper = min(m_index + 1, n_m - 1);
+  int s_upper = min(s_index + 1, n_s - 1);
+  double lower = get_row(m_index, s_index)[x] +
+    m_weight*(get_row(m_upper, s_index)[x] - get_row(m_index, s_index)[x]);
+  if (s_weight == 0) {
+    return lower;
+  }
+  double upper = get_row(m_index, s_upper)[x] +
+    m_weight*(get_row(m_upper, s_upper)[x] - get_row(m_index, s_upper)[x]);
+  return lower + s_weight*(upper - lower);
+}
+
+//------------------------------------------------
+// get log-density of delay distribution on day x directly from the gamma
+// distribution, using the same mapping from s to Erlang shape as the table
+double Lookup::get_log_density_exact(int x, double m, double s) const {
+  double shape = spec.interp_s ? s + 1 : floor(s) + 1;
+  if ((x < 0) || !(m > 0) || !(shape > 0)) {
+    return log_density_min;
+  }
+  double ret = R::pgamma(x + 1, shape, m/shape, true, false) - R::pgamma(x, shape, m/shape, true, false);
+  return log(max(ret, 0.0) + 1e-200);
+}
+
+//------------------------------------------------
+// log-likelihood of sparse day counts given mean and shape. days must be in
+// increasing order, with the first n_lookup days inside the range of the
+// table. Rows are gathered directly when no interpolation is needed, and
+// blended between the neighbouring grid points otherwise
+double Lookup::get_loglike(double m, double s, const int *day, const int *count,
+                           int n_lookup, int n_day) const {
+  
+  double ret = 0.0;
+  
+  // outside the grid, calculate every day exactly
+  int m_index, s_index;
+  double m_weight, s_weight;
+  if (!get_cell(m, s, m_index, s_index, m_weight, s_weight)) {
+    for (int k = 0; k < n_day; ++k) {
+      ret += count[k] * get_log_density_exact(day[k], m, s);
+    }
+    return ret;
+  }
+  
+  // days inside the table
+  int m_upper = min(m_index + 1, n_m - 1);
+  int s_upper = min(s_index + 1, n_s - 1);
+  const double *row_00 = get_row(m_index, s_index);
+  const double *row_10 = get_row(m_upper, s_index);
+  if (s_weight == 0) {
+    if (m_weight == 0) {
+      for (int k = 0; k < n_lookup; ++k) {
+        ret += count[k] * row_00[day[k]];
+      }
+    } else {
+      for (int k = 0; k < n_lookup; ++k) {
+        double a = row_00[day[k]];
+        ret += count[k] * (a + m_weight*(row_10[day[k]] - a));
+      }
+    }
+  } else {
+    const double *row_01 = get_row(m_index, s_upper);
+    const double *row_11 = get_row(m_upper, s_upper);
+    for (int k = 0; k < n_lookup; ++k) {
+      double a = row_00[day[k]];
+      double b = row_01[day[k]];
+      double lower = a + m_weight*(row_10[day[k]] - a);
+      double upper = b + m_weight*(row_11[day[k]] - b);
+      ret += count[k] * (lower + s_weight*(upper - lower));
+    }
+  }
+  
+  // days beyond the table
+  for (int k = n_lookup; k < n_day; ++k) {
+    ret += count[k] * get_log_density_exact(day[k], m, s);
+  }
+  
+  return ret;
+}
+
+//------------------------------------------------
+// log-likelihood of sparse day counts as in get_loglike(), along with its
+// derivatives with respect to m and s. Inside the table these are the exact
+// derivatives of the interpolated log-densities, which are zero in any
+// dimension that is not interpolated. Elsewhere they are found by central
+// differences of the exact log-densities
+double Lookup::get_loglike_grad(double m, double s, const int *day, const int *count,
+                                int n_lookup, int n_day, double &d_m, double &d_s) const {
+  
+  double ret = 0.0;
+  d_m = 0.0;
+  d_s = 0.0;
+  
+  // outside the grid, calculate every day exactly
+  int m_index, s_index;
+  double m_weight, s_weight;
+  if (!get_cell(m, s, m_index, s_index, m_weight, s_weight)) {
+    n_lookup = 0;
+  }
+  
+  // days inside the table. The derivative in s is taken within the cell above
+  // the grid point when s lies exactly on one
+  if (n_lookup > 0) {
+    int m_upper = min(m_index + 1, n_m - 1);
+    int s_upper = min(s_index + 1, n_s - 1);
+    const double *row_00 = get_row(m_index, s_index);
+    const double *row_10 = get_row(m_upper, s_index);
+    const double *row_01 = get_row(m_index, s_upper);
+    const double *row_11 = get_row(m_upper, s_upper);
+    bool grad_s = spec.interp_s && (n_s > 1);
+    double grad_m_sum = 0.0;
+    for (int k = 0; k < n_lookup; ++k) {
+      double a = row_00[day[k]];
+      double lower = a + m_weight*(row_10[day[k]] - a);
+      if (grad_s) {
+        double b = row_01[day[k]];
+        double upper = b + m_weight*(row_11[day[k]] - b);
+        ret += count[k] * (lower + s_weight*(upper - lower));
+        grad_m_sum += count[k] * ((row_10[day[k]] - a) + s_weight*((row_11[day[k]] - b) - (row_10[day[k]] - a)));
+        d_s += count[k] * (upper - lower);
+      } else {
+        ret += count[k] * lower;
+        grad_m_sum += count[k] * (row_10[day[k]] - a);
+      }
+    }
+    if (spec.interp_m) {
+      d_m = grad_m_sum * m_scale;
+    }
+  }
+  
+  // days beyond the table, or every day outside the grid
+  for (int k = n_lookup; k < n_day; ++k) {
+    double x_m, x_s;
+    ret += count[k] * get_log_density_exact(day[k], m, s);
+    get_log_density_exact_grad(day[k], m, s, x_m, x_s);
+    d_m += count[k] * x_m;
+    d_s += count[k] * x_s;
+  }
+  
+  return ret;
+}
+
+//------------------------------------------------
+// log-probability of the gamma distribution falling in [x, x+1), taken from
+// whichever tail avoids the loss of precision of subtracting cumulative
+// probabilities close to one
+static double log_interval_prob(int x, double shape, double scale) {
+  double ret;
+  if (R::pgamma(x, shape, scale, true, false) < 0.5) {
+    ret = R::pgamma(x + 1, shape, scale, true, false) - R::pgamma(x, shape, scale, true, false);
+  } else {
+    ret = R::pgamma(x, shape, scale, false, false) - R::pgamma(x + 1, shape, scale, false, false);
+  }
+  return log(max(ret, 0.0) + 1e-200);
+}
+
+//------------------------------------------------
+// derivatives of the exact log-density on day x with respect to m and s, by
+// central differences. Differences are taken of log-probabilities evaluated
+// from the more precise tail, as rounding error in the upper tail would
+// otherwise swamp the derivative. The derivative in s is zero unless
+// interpolating in s, as the Erlang shape is otherwise a step function of s
+void Lookup::get_log_density_exact_grad(int x, double m, double s, double &d_m, double &d_s) const {
+  d_m = 0.0;
+  d_s = 0.0;
+  double shape = spec.interp_s ? s + 1 : floor(s) + 1;
+  if ((x < 0) || !(m > 0) || !(shape > 0)) {
+    return;
+  }
+  double h_m = 1e-5*m;
+  d_m = (log_interval_prob(x, shape, (m + h_m)/shape) - log_interval_prob(x, shape, (m - h_m)/shape)) / (2*h_m);
+  if (spec.interp_s) {
+    double h_s = 1e-5*shape;
+    d_s = (log_interval_prob(x, shape + h_s, m/(shape + h_s)) - log_interval_prob(x, shape - h_s, m/(shape - h_s))) / (2*h_s);
+  }
+}
+
+//------------------------------------------------
+// return the lookup table matching a grid specification, building it on first
+// use. The cache is guarded by a mutex, and entries are never removed, so
+// references remain valid for the lifetime of the process
+const Lookup & get_lookup(const LookupSpec &spec) {
+  static mutex cache_mutex;
+  static map<LookupSpec, unique_ptr<Lookup>> cache;
+  lock_guard<mutex> lock(cache_mutex);
+  unique_ptr<Lookup> &entry = cache[spec];
+  if (!entry) {
+    entry = unique_ptr<Lookup>(new Lookup);
+    entry->init(spec);
+  }
+  return *entry;
+}
@@ -0,0 +1,92 @@
+
+#pragma once
+
+#include <vector>
+
+//------------------------------------------------
+// grid specification of a lookup table. Mean durations run from 0 to m_max in
+// steps of m_step, grid shape indices from 0 to (n_s-1), and days from 0 to
+// x_max. If interp_m or interp_s are true then log-densities are linearly
+// interpolated between neighbouring grid points in that dimension, otherwise
+// the grid point below is used
+struct LookupSpec {
+  
+  double m_max = 20;
+  double m_step = 0.01;
+  int n_s = 10;
+  int x_max = 100;
+  bool interp_m = true;
+  bool interp_s = false;
+  
+  // ordering so that specs can be used as keys of the table cache
+  bool operator<(const LookupSpec &other) const;
+};
+
+//------------------------------------------------
+// class holding a lookup table of the log-density of the Erlang distribution
+// discretised into days. The table is stored as a single flat vector indexed
+// by [m][s][x], where m runs over a grid of mean durations, s over integer
+// shape parameters, and x over days. The table is immutable once built, and is
+// shared read-only by every chain.
+//
+// The Erlang shape of grid index j is (j+1), and so a shape parameter s maps
+// to the shape floor(s)+1, or to s+1 when interpolating in s. Values of m and s
+// outside the grid, and days beyond x_max, fall back on calculating
+// log-densities exactly from the gamma distribution using the same mapping.
+class Lookup {
+  
+public:
+  // PUBLIC OBJECTS
+  
+  // grid specification
+  LookupSpec spec;
+  
+  // grid dimensions
+  int n_m;
+  double m_step;
+  double m_scale;
+  int n_s;
+  int n_x;
+  
+  // flat table of log-densities
+  std::vector<double> log_density;
+  
+  // floor on log-densities, guarding against underflow
+  double log_density_min;
+  
+  
+  // PUBLIC FUNCTIONS
+  
+  // constructors
+  Lookup() {};
+  
+  // public methods
+  void init(const LookupSpec &spec);
+  double get_log_density(int x, double m, double s) const;
+  double get_log_density_exact(int x, double m, double s) const;
+  double get_loglike(double m, double s, const int *day, const int *count,
+                     int n_lookup, int n_day) const;
+  double get_loglike_grad(double m, double s, const int *day, const int *count,
+                          int n_lookup, int n_day, double &d_m, double &d_s) const;
+  void get_log_density_exact_grad(int x, double m, double s, double &d_m, double &d_s) const;
+  
+  // pointer to the start of the row over x for given grid indices
+  const double * get_row(int m_index, int s_index) const {
+    return &log_density[(m_index*n_s + s_index)*n_x];
+  }
+  
+private:
+  
+  // find the grid cell containing (m, s), returning false if outside the grid.
+  // On success m_index and s_index give the lower corner, and m_weight and
+  // s_weight the interpolation weights of the upper neighbours
+  bool get_cell(double m, double s, int &m_index, int &s_index,
+                double &m_weight, double &s_weight) const;
+  
+};
+
+//------------------------------------------------
+// return the lookup table matching a grid specification, building it on first
+// use. Tables are cached for the lifetime of the process, and are shared by all
+// chains and runs using the same specification
+const Lookup & get_lookup(const LookupSpec &spec = LookupSpec());
@@ -0,0 +1,218 @@
+
+#include "OnlineStats.h"
+
+#include <math.h>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+static const double NaN = numeric_limits<double>::quiet_NaN();
+
+//------------------------------------------------
+// add all values summarised by another object, by the pairwise update of Chan
+// et al.
+void Welford::merge(const Welford &other) {
+  if (other.n == 0) {
+    return;
+  }
+  if (n == 0) {
+    *this = other;
+    return;
+  }
+  int n_total = n + other.n;
+  double delta = other.mean - mean;
+  mean += delta*other.n / n_total;
+  m2 += other.m2 + delta*delta*double(n)*other.n / n_total;
+  n = n_total;
+}
+
+//------------------------------------------------
+// sample variance
+double Welford::get_variance() const {
+  if (n < 2) {
+    return NaN;
+  }
+  return m2 / (n - 1);
+}
+
+//------------------------------------------------
+// standard error of the mean, from the variance of batch means
+double BatchMeans::get_se() const {
+  int n_batch = int(batch_vec.size());
+  if (n_batch < 2) {
+    return NaN;
+  }
+  Welford batch_means;
+  for (const Welford &b : batch_vec) {
+    batch_means.push(b.mean);
+  }
+  return sqrt(batch_means.get_variance() / n_batch);
+}
+
+//------------------------------------------------
+// effective sample size, as the ratio of the variance of the series to the
+// variance of the mean of its batches, scaled by the batch size
+double BatchMeans::get_ess() const {
+  if (batch_vec.size() < 2) {
+    return NaN;
+  }
+  Welford batch_means;
+  for (const Welford &b : batch_vec) {
+    batch_means.push(b.mean);
+  }
+  double var_batch = batch_means.get_variance();
+  if (!(var_batch > 0)) {
+    return NaN;
+  }
+  return values.n*values.get_variance() / (batch_size*var_batch);
+}
+
+//------------------------------------------------
+// first and last halves of complete batches
+void BatchMeans::get_halves(Welford &first, Welford &second) const {
+  int n_batch = int(batch_vec.size());
+  int n_half = n_batch / 2;
+  first = Welford();
+  second = Welford();
+  for (int b = 0; b < n_half; ++b) {
+    first.merge(batch_vec[b]);
+    second.merge(batch_vec[n_batch - n_half + b]);
+  }
+}
+
+//------------------------------------------------
+// write complete state
+void BatchMeans::save_state(CheckpointWriter &writer) const {
+  writer.write(batch_size);
+  writer.write(values);
+  writer.write(batch_vec);
+  writer.write(batch);
+}
+
+//------------------------------------------------
+// restore state written by save_state(). The number of complete batches is
+// read before the batches themselves
+void BatchMeans::load_state(CheckpointReader &reader) {
+  reader.read(batch_size);
+  reader.read(values);
+  int n_batch;
+  reader.read(n_batch);
+  if (n_batch < 0) {
+    throw runtime_error("checkpoint file " + reader.path + " is truncated or corrupt");
+  }
+  batch_vec.resize(n_batch);
+  reader.read_array(batch_vec.data(), n_batch);
+  reader.read(batch);
+}
+
+//------------------------------------------------
+// add value. Each new value is multiplied by each of the max_lag values before
+// it, which are held in the circular buffer
+void Autocorrelation::push(double x) {
+  if (n == 0) {
+    shift = x;
+  }
+  double y = x - shift;
+  lag_sum[0] += y*y;
+  int n_lag = min(n, max_lag);
+  for (int k = 1; k <= n_lag; ++k) {
+    lag_sum[k] += y*recent[(n - k) % max_lag];
+  }
+  if (max_lag > 0) {
+    recent[n % max_lag] = y;
+  }
+  if (n < max_lag) {
+    head.push_back(y);
+  }
+  sum += y;
+  n++;
+}
+
+//------------------------------------------------
+// autocorrelation at each lag. The autocovariance at lag k is found from the
+// sum of lagged products by subtracting the mean from both terms, for which
+// the sums of values excluding the first and last k values are needed
+vector<double> Autocorrelation::get_acf() const {
+  vector<double> ret(max_lag + 1, NaN);
+  if (n < 2) {
+    return ret;
+  }
+  double mean = sum / n;
+  double sum_first = 0.0;
+  double sum_last = 0.0;
+  double cov0 = 0.0;
+  for (int k = 0; k <= min(max_lag, n - 1); ++k) {
+    if (k > 0) {
+      sum_first += head[k-1];
+      sum_last += recent[(n - k) % max_lag];
+    }
+    double cov = lag_sum[k] - mean*((sum - sum_last) + (sum - sum_first)) + (n - k)*mean*mean;
+    if (k == 0) {
+      cov0 = cov;
+      if (!(cov0 > 0)) {
+        return ret;
+      }
+    }
+    ret[k] = cov / cov0;
+  }
+  return ret;
+}
+
+//------------------------------------------------
+// write complete state
+void Autocorrelation::save_state(CheckpointWriter &writer) const {
+  writer.write(max_lag);
+  writer.write(n);
+  writer.write(shift);
+  writer.write(sum);
+  writer.write(head);
+  writer.write(recent);
+  writer.write(lag_sum);
+}
+
+//------------------------------------------------
+// restore state written by save_state(). The object must already have been
+// constructed with the same max_lag
+void Autocorrelation::load_state(CheckpointReader &reader) {
+  int max_lag_stored;
+  reader.read(max_lag_stored);
+  if (max_lag_stored != max_lag) {
+    throw runtime_error("checkpoint file " + reader.path + " is truncated or corrupt");
+  }
+  reader.read(n);
+  reader.read(shift);
+  reader.read(sum);
+  head.resize(min(n, max_lag));
+  reader.read(head);
+  reader.read(recent);
+  reader.read(lag_sum);
+}
+
+//------------------------------------------------
+// potential scale reduction factor, from the within-sequence variance W and
+// the between-sequence variance B. Sequences are taken to have their mean
+// length
+double rhat(const vector<Welford> &sequences) {
+  int m = int(sequences.size());
+  if (m < 2) {
+    return NaN;
+  }
+  double n = 0.0;
+  double W = 0.0;
+  Welford means;
+  for (const Welford &x : sequences) {
+    n += x.n;
+    W += x.get_variance();
+    means.push(x.mean);
+  }
+  n /= m;
+  W /= m;
+  if (!(W > 0)) {
+    return NaN;
+  }
+  double B = n*means.get_variance();
+  double var_plus = (n - 1)/n*W + B/n;
+  return sqrt(var_plus / W);
+}
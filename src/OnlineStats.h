@@ -0,0 +1,146 @@
+
+#pragma once
+
+#include "Checkpoint.h"
+
+#include <vector>
+
+//------------------------------------------------
+// running mean and variance of a series, updated one value at a time by
+// Welford's algorithm, which avoids the loss of precision of summing squares
+class Welford {
+  
+public:
+  // PUBLIC OBJECTS
+  
+  int n;
+  double mean;
+  double m2;
+  
+  
+  // PUBLIC FUNCTIONS
+  
+  // constructors
+  Welford() : n(0), mean(0.0), m2(0.0) {};
+  
+  // add value
+  void push(double x) {
+    n++;
+    double delta = x - mean;
+    mean += delta / n;
+    m2 += delta*(x - mean);
+  }
+  
+  // add all values summarised by another object
+  void merge(const Welford &other);
+  
+  // sample variance, or NaN if fewer than two values
+  double get_variance() const;
+  
+};
+
+//------------------------------------------------
+// running mean and variance of a series, along with the mean and variance of
+// each complete batch of batch_size consecutive values. The batch means give
+// the Monte Carlo standard error of the mean of an autocorrelated series, and
+// hence the effective sample size, as long as batches are much longer than the
+// autocorrelation time. Batches also give the two halves of the series used by
+// split-Rhat. A final incomplete batch contributes to the mean and variance,
+// but not to the standard error or the halves
+class BatchMeans {
+  
+public:
+  // PUBLIC OBJECTS
+  
+  int batch_size;
+  Welford values;
+  
+  // complete batches, and the current incomplete batch
+  std::vector<Welford> batch_vec;
+  Welford batch;
+  
+  
+  // PUBLIC FUNCTIONS
+  
+  // constructors
+  BatchMeans(int batch_size = 1) : batch_size(batch_size) {};
+  
+  // add value
+  void push(double x) {
+    values.push(x);
+    batch.push(x);
+    if (batch.n == batch_size) {
+      batch_vec.push_back(batch);
+      batch = Welford();
+    }
+  }
+  
+  // mean, variance, standard error of the mean and effective sample size. The
+  // standard error and effective sample size are NaN if fewer than two batches
+  // are complete
+  double get_mean() const {
+    return values.mean;
+  }
+  double get_variance() const {
+    return values.get_variance();
+  }
+  double get_se() const;
+  double get_ess() const;
+  
+  // first and last halves of complete batches, dropping the middle batch if
+  // there is an odd number
+  void get_halves(Welford &first, Welford &second) const;
+  
+  // write to or restore from a checkpoint
+  void save_state(CheckpointWriter &writer) const;
+  void load_state(CheckpointReader &reader);
+  
+};
+
+//------------------------------------------------
+// running autocorrelation of a series at lags 0 to max_lag, matching
+// stats::acf() over all values pushed so far. Lagged products are accumulated
+// as each value arrives, keeping only the first and most recent max_lag
+// values, so that the full series is never held in memory. Values are shifted
+// by the first value to avoid the loss of precision of large offsets
+class Autocorrelation {
+  
+public:
+  // PUBLIC OBJECTS
+  
+  int max_lag;
+  int n;
+  double shift;
+  double sum;
+  
+  // first max_lag shifted values, circular buffer of the most recent max_lag
+  // shifted values, and sums of lagged products at each lag
+  std::vector<double> head;
+  std::vector<double> recent;
+  std::vector<double> lag_sum;
+  
+  
+  // PUBLIC FUNCTIONS
+  
+  // constructors
+  Autocorrelation(int max_lag = 0) : max_lag(max_lag), n(0), shift(0.0), sum(0.0),
+                                     recent(max_lag), lag_sum(max_lag + 1) {};
+  
+  // add value
+  void push(double x);
+  
+  // autocorrelation at lags 0 to max_lag, with NaN at lags that cannot be
+  // calculated
+  std::vector<double> get_acf() const;
+  
+  // write to or restore from a checkpoint
+  void save_state(CheckpointWriter &writer) const;
+  void load_state(CheckpointReader &reader);
+  
+};
+
+//------------------------------------------------
+// potential scale reduction factor of Gelman et al. (BDA3) over several
+// sequences of equal length, such as the two halves of each of several chains
+// when calculating split-Rhat. NaN if the within-sequence variance is zero
+double rhat(const std::vector<Welford> &sequences);
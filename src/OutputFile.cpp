@@ -0,0 +1,178 @@
+
+#include "OutputFile.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <share.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// identifies output files, and their format version
+static const char OUTPUT_MAGIC[8] = {'M', 'K', 'V', 'O', 'U', 'T', '0', '1'};
+
+//------------------------------------------------
+// create a new file and write the header
+void OutputFile::create(System &s, const string &path, int precision) {
+  
+  this->path = path;
+  this->precision = precision;
+  stream.open(path, ios::out | ios::binary | ios::trunc);
+  if (!stream) {
+    throw runtime_error("could not open output file " + path + " for writing");
+  }
+  
+  // header
+  int n_store = int(s.store_rungs.size());
+  vector<int> header = {precision, s.chain, s.d, s.burnin, s.thin, s.n_store_burnin, n_store};
+  for (int j = 0; j < n_store; ++j) {
+    header.push_back(s.store_rungs[j] + 1);
+  }
+  stream.write(OUTPUT_MAGIC, 8);
+  stream.write(reinterpret_cast<const char *>(header.data()), header.size()*sizeof(int));
+}
+
+//------------------------------------------------
+// shorten the file at path to offset bytes in place, returning false on failure
+static bool truncate_file(const string &path, int64_t offset) {
+#ifdef _WIN32
+  int fd;
+  if (_sopen_s(&fd, path.c_str(), _O_RDWR | _O_BINARY, _SH_DENYNO, _S_IREAD | _S_IWRITE) != 0) {
+    return false;
+  }
+  bool ret = (_chsize_s(fd, offset) == 0);
+  _close(fd);
+  return ret;
+#else
+  return (truncate(path.c_str(), off_t(offset)) == 0);
+#endif
+}
+
+//------------------------------------------------
+// re-open an existing file after a checkpoint. Blocks written after the
+// checkpoint are discarded by truncating the file in place to offset bytes
+void OutputFile::reopen(const string &path, int precision, int64_t offset) {
+  
+  this->path = path;
+  this->precision = precision;
+  {
+    ifstream in(path, ios::in | ios::binary | ios::ate);
+    if (!in) {
+      throw runtime_error("could not re-open output file " + path);
+    }
+    if (int64_t(in.tellg()) < offset) {
+      throw runtime_error("output file " + path + " is shorter than its checkpoint");
+    }
+  }
+  if (!truncate_file(path, offset)) {
+    throw runtime_error("could not truncate output file " + path);
+  }
+  stream.open(path, ios::in | ios::out | ios::binary);
+  stream.seekp(0, ios::end);
+  if (!stream) {
+    throw runtime_error("could not open output file " + path + " for writing");
+  }
+}
+
+//------------------------------------------------
+// append a block of stored iterations
+void OutputFile::write_block(int k0, int n_rows, int n_store, int stride,
+                             const vector<double *> &columns) {
+  
+  int index[2] = {k0, n_rows};
+  stream.write(reinterpret_cast<const char *>(index), 2*sizeof(int));
+  for (int j = 0; j < n_store; ++j) {
+    for (double * col : columns) {
+      const double *x = col + j*stride;
+      if (precision == 4) {
+        buffer_float.assign(x, x + n_rows);
+        stream.write(reinterpret_cast<const char *>(buffer_float.data()), n_rows*sizeof(float));
+      } else {
+        stream.write(reinterpret_cast<const char *>(x), n_rows*sizeof(double));
+      }
+    }
+  }
+  if (!stream) {
+    throw runtime_error("failed writing output file " + path);
+  }
+}
+
+//------------------------------------------------
+// overwrite the burn-in length in the header, which follows the magic number,
+// precision, chain and d, and return to the end of the file
+void OutputFile::set_burnin(int burnin) {
+  streampos end = stream.tellp();
+  stream.seekp(8 + 3*sizeof(int));
+  stream.write(reinterpret_cast<const char *>(&burnin), sizeof(int));
+  stream.seekp(end);
+  if (!stream) {
+    throw runtime_error("failed writing output file " + path);
+  }
+}
+
+//------------------------------------------------
+// read blocks back into columns, up to byte offset
+void OutputFile::read_blocks(const string &path, int64_t offset, int n_store,
+                             int stride, const vector<double *> &columns) {
+  
+  ifstream in(path, ios::in | ios::binary);
+  if (!in) {
+    throw runtime_error("could not open output file " + path + " for reading");
+  }
+  
+  // header
+  char magic[8];
+  int header[7];
+  in.read(magic, 8);
+  in.read(reinterpret_cast<char *>(header), 7*sizeof(int));
+  if (!in || !equal(magic, magic + 8, OUTPUT_MAGIC) || (header[6] != n_store) ||
+      (header[2] + 2 != int(columns.size()))) {
+    throw runtime_error(path + " does not match the current model");
+  }
+  int file_precision = header[0];
+  in.seekg(n_store*sizeof(int), ios::cur);
+  
+  // blocks
+  vector<float> buffer_float;
+  while (in && (int64_t(in.tellg()) < offset)) {
+    int index[2];
+    in.read(reinterpret_cast<char *>(index), 2*sizeof(int));
+    int k0 = index[0];
+    int n_rows = index[1];
+    if (!in || (k0 < 0) || (n_rows < 0) || (k0 + n_rows > stride)) {
+      throw runtime_error("failed reading output file " + path);
+    }
+    for (int j = 0; j < n_store; ++j) {
+      for (double * col : columns) {
+        double *x = col + j*stride + k0;
+        if (file_precision == 4) {
+          buffer_float.resize(n_rows);
+          in.read(reinterpret_cast<char *>(buffer_float.data()), n_rows*sizeof(float));
+          copy(buffer_float.begin(), buffer_float.end(), x);
+        } else {
+          in.read(reinterpret_cast<char *>(x), n_rows*sizeof(double));
+        }
+      }
+    }
+  }
+  if (!in || (int64_t(in.tellg()) != offset)) {
+    throw runtime_error("failed reading output file " + path);
+  }
+}
+
+//------------------------------------------------
+// flush buffered writes and return the current size of the file in bytes
+int64_t OutputFile::sync() {
+  stream.flush();
+  if (!stream) {
+    throw runtime_error("failed writing output file " + path);
+  }
+  return int64_t(stream.tellp());
+}
@@ -0,0 +1,73 @@
+
+#pragma once
+
+#include "System.h"
+
+#include <stdint.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+//------------------------------------------------
+// class for streaming stored MCMC output of a single chain to an append-only
+// binary file. The file starts with a header, followed by any number of blocks
+// of consecutive stored iterations. Within a block, values are grouped by
+// stored rung and then by column (logprior, loglikelihood, then one column per
+// parameter), so that each column of each rung is a contiguous array. Values
+// are written in native byte order as either 4-byte floats or 8-byte doubles.
+//
+// header: magic (8 bytes), precision, chain, d, burnin, thin, n_store_burnin,
+//         n_store, store_rungs (one-based, n_store values), all 4-byte ints.
+//         burnin is the burn-in length actually run, which can be shorter
+//         than that implied by n_store_burnin when burn-in stops early
+// block:  first stored iteration index, number of rows (4-byte ints), followed
+//         by n_store*(d+2)*rows values. Stored iteration indices count from
+//         the first burn-in iteration, with sampling always starting at
+//         n_store_burnin
+class OutputFile {
+  
+public:
+  // PUBLIC OBJECTS
+  
+  std::string path;
+  std::ofstream stream;
+  int precision;
+  
+  // scratch space for converting to single precision
+  std::vector<float> buffer_float;
+  
+  
+  // PUBLIC FUNCTIONS
+  
+  // constructors
+  OutputFile() {};
+  
+  // create a new file and write the header, or re-open an existing file for
+  // appending after discarding everything past byte offset. precision is the
+  // number of bytes per value, 4 or 8
+  void create(System &s, const std::string &path, int precision);
+  void reopen(const std::string &path, int precision, int64_t offset);
+  
+  // append a block of n_rows stored iterations, starting at stored iteration
+  // k0. columns holds one pointer per column, each pointing to n_store arrays of
+  // stride values, of which the first n_rows are written
+  void write_block(int k0, int n_rows, int n_store, int stride,
+                   const std::vector<double *> &columns);
+  
+  // overwrite the burn-in length in the header, once burn-in is complete
+  void set_burnin(int burnin);
+  
+  // flush buffered writes and return the current size of the file in bytes
+  int64_t sync();
+  
+  // read every block in the first offset bytes of the file at path back into
+  // columns, laid out as in write_block(), with each block placed at its
+  // stored iteration index
+  static void read_blocks(const std::string &path, int64_t offset, int n_store,
+                          int stride, const std::vector<double *> &columns);
+  
+  bool is_open() const {
+    return stream.is_open();
+  }
+  
+};
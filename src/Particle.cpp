@@ -7,31 +7,31 @@
 
 using namespace std;
 
+// use the lookup table for delay log-densities, rather than calculating them
+// directly from the gamma distribution
+#define USE_LOOKUP
+
 //------------------------------------------------
 // initialise/reset particle
-void Particle::init(System &s) {
+void Particle::init(System &s, const RNG &rng) {
   
   // pointer to system object
   this->s_ptr = &s;
   
+  // random number stream
+  this->rng = rng;
+  
   // parameters
   d = s_ptr->d;
   
-  // vector over ages for cubic splines
-  age_seq = vector<double>(s_ptr->max_indlevel_age + 1);
-  for (unsigned int i = 0; i < age_seq.size(); ++i) {
-    age_seq[i] = i;
-  }
+  // transition spline nodes and spline values
+  p_node = vector<vector<double>>(s_ptr->n_trans, vector<double>(s_ptr->n_node));
+  p_spline = vector<vector<double>>(s_ptr->n_trans, vector<double>(s_ptr->n_age));
+  p_spline_prop = vector<vector<double>>(s_ptr->n_trans, vector<double>(s_ptr->n_age));
   
-  // transition probabilities
-  p_AI_node = vector<double>(s_ptr->n_node);
-  p_AI = vector<double>(s_ptr->max_indlevel_age + 1);
-  p_AD_node = vector<double>(s_ptr->n_node);
-  p_AD = vector<double>(s_ptr->max_indlevel_age + 1);
-  p_ID_node = vector<double>(s_ptr->n_node);
-  p_ID = vector<double>(s_ptr->max_indlevel_age + 1);
-  p_SD_node = vector<double>(s_ptr->n_node);
-  p_SD = vector<double>(s_ptr->max_indlevel_age + 1);
+  // position of durations in theta
+  m_offset = s_ptr->n_trans*s_ptr->n_node;
+  s_offset = m_offset + s_ptr->n_dur;
   
   // theta is the parameter vector in natural space
   theta = s_ptr->theta_init;
@@ -47,104 +47,141 @@ void Particle::init(System &s) {
   bw_index = vector<int>(d, 1);
   bw_stepsize = 1.0;
   
+  // evaluation counts and timings
+#ifdef MARKOVID_PROFILE
+  profile.init(d);
+#endif
+  
+  // block proposals start from the identity covariance
+  int n_blocks = int(s_ptr->update_blocks.size());
+  block_mean = vector<vector<double>>(n_blocks);
+  block_sumsq = vector<vector<vector<double>>>(n_blocks);
+  block_cov = vector<vector<vector<double>>>(n_blocks);
+  block_chol = vector<vector<vector<double>>>(n_blocks);
+  block_phi = vector<vector<double>>(n_blocks);
+  block_phi_prop = vector<vector<double>>(n_blocks);
+  block_scale = vector<double>(n_blocks);
+  block_index = vector<int>(n_blocks, 1);
+  for (int b = 0; b < n_blocks; ++b) {
+    int n = int(s_ptr->update_blocks[b].size());
+    block_mean[b] = vector<double>(n);
+    block_sumsq[b] = vector<vector<double>>(n, vector<double>(n));
+    block_cov[b] = vector<vector<double>>(n, vector<double>(n));
+    block_chol[b] = vector<vector<double>>(n, vector<double>(n));
+    for (int j = 0; j < n; ++j) {
+      block_chol[b][j][j] = 1.0;
+    }
+    block_phi[b] = vector<double>(n);
+    block_phi_prop[b] = vector<double>(n);
+    block_scale[b] = 2.38 / sqrt(double(n));
+  }
+  cov_n = 0;
+  adapt_blocks = true;
+  
+  // Hamiltonian Monte Carlo step sizes start from 0.1, and are shrunk toward
+  // ten times this value
+  hmc_log_step = vector<double>(n_blocks, log(0.1));
+  hmc_log_step_bar = vector<double>(n_blocks);
+  hmc_h_bar = vector<double>(n_blocks);
+  hmc_mu = vector<double>(n_blocks, log(1.0));
+  grad_loglike = vector<double>(d);
+  grad_logprior = vector<double>(d);
+  grad_loglike_prop = vector<double>(d);
+  grad_logprior_prop = vector<double>(d);
+  hmc_momentum = vector<double>(d);
+  hmc_grad = vector<double>(d);
+  trans_resid = vector<double>(s_ptr->n_age);
+  
+  // surrogate values are calculated on the first screened proposal
+  p_screen = vector<vector<double>>(s_ptr->n_trans);
+  p_screen_prop = vector<vector<double>>(s_ptr->n_trans);
+  for (int t = 0; t < s_ptr->n_trans; ++t) {
+    p_screen[t] = vector<double>(s_ptr->n_screen[t]);
+    p_screen_prop[t] = vector<double>(s_ptr->n_screen[t]);
+  }
+  screen_loglike = vector<double>(s_ptr->n_trans);
+  screen_valid = false;
+  screen_count = 0;
+  screen_pass = 0;
+  
   // likelihoods and priors
-  loglike = get_loglike(theta, 0);
+  loglike_block = vector<double>(s_ptr->n_block);
+  loglike_block_prop = vector<double>(s_ptr->n_block);
+  loglike = get_loglike(theta, -1);
+  accept_loglike();
   loglike_prop = 0;
   logprior = get_logprior(theta, 0);
   logprior_prop = 0;
+  if (s_ptr->hmc_update) {
+    init_grad();
+  }
   
   // acceptance rates
   accept_count = 0;
 }
 
 //------------------------------------------------
-// transform phi_prop to theta_prop. See main.R for a key to transformation
-// types
+// transform phi_prop to theta_prop, through the transformation resolved for
+// parameter i at load time
 void Particle::phi_prop_to_theta_prop(int i) {
-  
-  switch(s_ptr->trans_type[i]) {
-  case 0:
-    theta_prop[i] = phi_prop[i];
-    break;
-  case 1:
-    theta_prop[i] = s_ptr->theta_max[i] - exp(phi_prop[i]);
-    break;
-  case 2:
-    theta_prop[i] = exp(phi_prop[i]) + s_ptr->theta_min[i];
-    break;
-  case 3:
-    theta_prop[i] = (s_ptr->theta_max[i]*exp(phi_prop[i]) + s_ptr->theta_min[i]) / (1 + exp(phi_prop[i]));
-    break;
-  default:
-    Rcpp::stop("trans_type invalid");
-  }
-  
+  theta_prop[i] = s_ptr->transform[i].to_theta(phi_prop[i]);
 }
 
 //------------------------------------------------
-// transform theta to phi. See main.R for a key to transformation types
+// transform theta to phi
 void Particle::theta_to_phi() {
-  
   for (int i = 0; i < d; ++i) {
-    switch(s_ptr->trans_type[i]) {
-    case 0:
-      phi[i] = theta[i];
-      break;
-    case 1:
-      phi[i] = log(s_ptr->theta_max[i] - theta[i]);
-      break;
-    case 2:
-      phi[i] = log(theta[i] - s_ptr->theta_min[i]);
-      break;
-    case 3:
-      phi[i] = log(theta[i] - s_ptr->theta_min[i]) - log(s_ptr->theta_max[i] - theta[i]);
-      break;
-    default:
-      Rcpp::stop("trans_type invalid");
-    }
+    phi[i] = s_ptr->transform[i].to_phi(theta[i]);
   }
-  
 }
 
 //------------------------------------------------
 // get adjustment factor to account for reparameterisation
 double Particle::get_adjustment(int i) {
-  
-  double ret = 0;
-  switch(s_ptr->trans_type[i]) {
-  case 0:
-    // (no adjustment needed)
-    break;
-  case 1:
-    ret = log(theta_prop[i] - s_ptr->theta_max[i]) - log(theta[i] - s_ptr->theta_max[i]);
-    break;
-  case 2:
-    ret = log(theta_prop[i] - s_ptr->theta_min[i]) - log(theta[i] - s_ptr->theta_min[i]);
-    break;
-  case 3:
-    ret = log(s_ptr->theta_max[i] - theta_prop[i]) + log(theta_prop[i] - s_ptr->theta_min[i]) - log(s_ptr->theta_max[i] - theta[i]) - log(theta[i] - s_ptr->theta_min[i]);
-    break;
-  default:
-    Rcpp::stop("trans_type invalid");
+  return s_ptr->transform[i].adjustment(theta_prop[i], theta[i]);
+}
+
+//------------------------------------------------
+// derivative with respect to phi[i] of the log target in phi space, given its
+// derivative grad with respect to theta[i]. The log Jacobian of the
+// transformation of parameter i is added to log_jacobian, and its derivative
+// is included in the return value
+double Particle::get_phi_grad(int i, const vector<double> &theta, double grad,
+                              double &log_jacobian) {
+  return s_ptr->transform[i].phi_grad(theta[i], grad, log_jacobian);
+}
+
+//------------------------------------------------
+// update all free parameters once. Hamiltonian Monte Carlo trajectories are
+// never screened, and moves that are not screened leave the surrogate values
+// out of date
+void Particle::update(double beta, bool delayed) {
+  if (!delayed || s_ptr->hmc_update) {
+    screen_valid = false;
+  }
+  if (s_ptr->hmc_update) {
+    update_hmc(beta);
+  } else if (s_ptr->block_update) {
+    update_block(beta, delayed);
+  } else {
+    update_univar(beta, delayed);
   }
-  return ret;
 }
 
 //------------------------------------------------
-void Particle::update(double beta) {
+// one univariate Metropolis-Hastings update per free parameter
+void Particle::update_univar(double beta, bool delayed) {
   
   // set theta_prop and phi_prop to current values of theta and phi
   theta_prop = theta;
   phi_prop = phi;
   
-  // loop through parameters
-  for (int i = 0; i < d; ++i) {
-    if (s_ptr->skip_param[i]) {
-      continue;
-    }
+  // loop through free parameters
+  for (int i : s_ptr->free_param) {
     
     // generate new phi_prop[i]
-    phi_prop[i] = rnorm1(phi[i], bw[i]);
+    PROFILE_START(t_update);
+    phi_prop[i] = rnorm1(rng, phi[i], bw[i]);
     
     // transform phi_prop[i] to theta_prop[i]
     phi_prop_to_theta_prop(i);
@@ -153,15 +190,22 @@ void Particle::update(double beta) {
     // moves
     double adj = get_adjustment(i);
     
-    // calculate likelihood and prior of proposed theta
-    loglike_prop = get_loglike(theta_prop, i);
-    logprior_prop = get_logprior(theta_prop, i);
-    
-    // calculate Metropolis-Hastings ratio
-    double MH = beta*(loglike_prop - loglike) + (logprior_prop - logprior) + adj;
-    
-    // accept or reject move
-    bool MH_accept = (log(runif_0_1()) < MH);
+    // accept or reject move, screening proposals to spline nodes first under
+    // delayed acceptance
+    bool MH_accept;
+    int t = s_ptr->param_block[i];
+    if (delayed && (t < s_ptr->n_trans)) {
+      MH_accept = accept_delayed(t, i % s_ptr->n_node, i, beta, adj);
+    } else {
+      
+      // calculate likelihood and prior of proposed theta
+      loglike_prop = get_loglike(theta_prop, i);
+      logprior_prop = get_logprior(theta_prop, i);
+      
+      // calculate Metropolis-Hastings ratio
+      double MH = beta*(loglike_prop - loglike) + (logprior_prop - logprior) + adj;
+      MH_accept = (log(runif_0_1(rng)) < MH);
+    }
     
     // implement changes
     if (MH_accept) {
@@ -173,6 +217,7 @@ void Particle::update(double beta) {
       // update likelihoods
       loglike = loglike_prop;
       logprior = logprior_prop;
+      accept_loglike();
       
       // Robbins-Monro positive update (on the log scale)
       bw[i] = exp(log(bw[i]) + bw_stepsize*(1 - 0.234)/sqrt(bw_index[i]));
@@ -192,165 +237,523 @@ void Particle::update(double beta) {
       bw_index[i]++;
       
     } // end MH step
+    PROFILE_PARAM(profile, i, MH_accept, t_update, 1.0);
     
   }  // end loop over parameters
-    
+  
 }  // end update_univar function
 
 //------------------------------------------------
-// define cpp loglike function
-double Particle::get_loglike(vector<double> &theta, int theta_i) {
+// one joint Metropolis-Hastings update per update block. Block scales are
+// tuned by Robbins-Monro, and proposal covariances are learned, only while
+// adapt_blocks is true
+void Particle::update_block(double beta, bool delayed) {
   
-  //return(0.0);
+  // set theta_prop and phi_prop to current values of theta and phi
+  theta_prop = theta;
+  phi_prop = phi;
   
-  // ----------------------------------------------------------------
-  // unpack parameters and define fixed/derived parameters
-  
-  // transition cubic spline nodes
-  int pi = 0;
-  for (int i = 0; i < s_ptr->n_node; ++i) {
-    p_AI_node[i] = theta[pi++];
-  }
-  for (int i = 0; i < s_ptr->n_node; ++i) {
-    p_AD_node[i] = theta[pi++];
-  }
-  for (int i = 0; i < s_ptr->n_node; ++i) {
-    p_ID_node[i] = theta[pi++];
-  }
-  for (int i = 0; i < s_ptr->n_node; ++i) {
-    p_SD_node[i] = theta[pi++];
-  }
-  
-  // mean durations
-  m_AI = theta[pi++];
-  m_AD = theta[pi++];
-  m_AC = theta[pi++];
-  m_ID = theta[pi++];
-  m_I1S = theta[pi++];
-  m_I2S = theta[pi++];
-  m_SD = theta[pi++];
-  m_SC = theta[pi++];
-  
-  // Erlang shape of durations
-  s_AI = theta[pi++];
-  s_AD = theta[pi++];
-  s_AC = theta[pi++];
-  s_ID = theta[pi++];
-  s_I1S = theta[pi++];
-  s_I2S = theta[pi++];
-  s_SD = theta[pi++];
-  s_SC = theta[pi++];
-  
-  // initialise loglikelihood
-  double ret = 0.0;
+  // loop through blocks
+  int n_blocks = int(s_ptr->update_blocks.size());
+  for (int b = 0; b < n_blocks; ++b) {
+    update_block_mh(b, beta, delayed);
+  }
   
+  // update proposal covariances
+  if (adapt_blocks) {
+    update_block_cov();
+  }
   
-  // ----------------------------------------------------------------
-  // calculate cubic plines
+}
+
+//------------------------------------------------
+// joint Metropolis-Hastings update of block b. theta_prop and phi_prop must
+// equal theta and phi on entry, and do so again on return. If delayed is true
+// and the block is a transition spline then the proposal is made by delayed
+// acceptance. Returns true if the proposal is accepted
+bool Particle::update_block_mh(int b, double beta, bool delayed) {
   
-  // get cubic spline for p_AI and transform to [0,1] interval
-  cubic_spline(s_ptr->node_x, p_AI_node, age_seq, p_AI);
-  for (unsigned int i = 0; i < p_AI.size(); ++i) {
-    p_AI[i] = 1.0 / (1.0 + exp(-p_AI[i]));
+  const vector<int> &block = s_ptr->update_blocks[b];
+  int n = int(block.size());
+  
+  // generate new phi_prop over the block
+  PROFILE_START(t_update);
+  for (int j = 0; j < n; ++j) {
+    block_phi[b][j] = phi[block[j]];
   }
+  rmnorm1(rng, block_phi_prop[b], block_phi[b], block_chol[b], block_scale[b]);
   
-  // get cubic spline for p_AD and transform to [0,1] interval
-  cubic_spline(s_ptr->node_x, p_AD_node, age_seq, p_AD);
-  for (unsigned int i = 0; i < p_AD.size(); ++i) {
-    p_AD[i] = 1.0 / (1.0 + exp(-p_AD[i]));
+  // transform to theta_prop, accumulating the adjustment factor
+  double adj = 0.0;
+  for (int j = 0; j < n; ++j) {
+    int i = block[j];
+    phi_prop[i] = block_phi_prop[b][j];
+    phi_prop_to_theta_prop(i);
+    adj += get_adjustment(i);
   }
   
-  // get cubic spline for p_ID and transform to [0,1] interval
-  cubic_spline(s_ptr->node_x, p_ID_node, age_seq, p_ID);
-  for (unsigned int i = 0; i < p_ID.size(); ++i) {
-    p_ID[i] = 1.0 / (1.0 + exp(-p_ID[i]));
+  // accept or reject move
+  bool MH_accept;
+  int t = s_ptr->update_block_loglike[b];
+  bool screened = delayed && (t >= 0) && (t < s_ptr->n_trans);
+  if (screened) {
+    MH_accept = accept_delayed(t, -1, block[0], beta, adj);
+  } else {
+    
+    // calculate likelihood and prior of proposed theta
+    loglike_prop = get_loglike_block(theta_prop, t, -1);
+    logprior_prop = get_logprior(theta_prop, block[0]);
+    
+    // calculate Metropolis-Hastings ratio
+    double MH = beta*(loglike_prop - loglike) + (logprior_prop - logprior) + adj;
+    MH_accept = (log(runif_0_1(rng)) < MH);
   }
   
-  // get cubic spline for p_SD and transform to [0,1] interval
-  cubic_spline(s_ptr->node_x, p_SD_node, age_seq, p_SD);
-  for (unsigned int i = 0; i < p_SD.size(); ++i) {
-    p_SD[i] = 1.0 / (1.0 + exp(-p_SD[i]));
+  // implement changes
+  if (MH_accept) {
+    
+    // update theta and phi
+    for (int j = 0; j < n; ++j) {
+      theta[block[j]] = theta_prop[block[j]];
+      phi[block[j]] = phi_prop[block[j]];
+    }
+    
+    // update likelihoods. Unscreened moves of spline nodes leave the
+    // surrogate values out of date
+    loglike = loglike_prop;
+    logprior = logprior_prop;
+    accept_loglike();
+    if (!screened && (t < s_ptr->n_trans)) {
+      screen_valid = false;
+    }
+    
+    // add to acceptance rate count
+    accept_count++;
+    
+  } else {
+    
+    // reset theta_prop and phi_prop
+    for (int j = 0; j < n; ++j) {
+      theta_prop[block[j]] = theta[block[j]];
+      phi_prop[block[j]] = phi[block[j]];
+    }
+    
+  } // end MH step
+  
+  // Robbins-Monro update of the block scale (on the log scale)
+  if (adapt_blocks) {
+    block_scale[b] = exp(log(block_scale[b]) + bw_stepsize*(MH_accept - 0.234)/sqrt(block_index[b]));
+    block_index[b]++;
   }
   
+  // each parameter in the block takes an equal share of the time
+#ifdef MARKOVID_PROFILE
+  for (int j = 0; j < n; ++j) {
+    PROFILE_PARAM(profile, block[j], MH_accept, t_update, 1.0/n);
+  }
+#endif
   
-  // ----------------------------------------------------------------
-  // individual-level component of likelihood
+  return MH_accept;
+}
+
+//------------------------------------------------
+// one Hamiltonian Monte Carlo trajectory per update block, falling back on a
+// joint Metropolis-Hastings update for blocks whose loglikelihood is not
+// differentiable. Step sizes and block scales are tuned, and proposal
+// covariances learned, only while adapt_blocks is true
+void Particle::update_hmc(double beta) {
+  
+  // set theta_prop and phi_prop to current values of theta and phi
+  theta_prop = theta;
+  phi_prop = phi;
+  
+  // loop through blocks
+  int n_blocks = int(s_ptr->update_blocks.size());
+  for (int b = 0; b < n_blocks; ++b) {
+    if (s_ptr->update_block_hmc[b]) {
+      update_block_hmc(b, beta);
+    } else if (update_block_mh(b, beta)) {
+      
+      // gradients are otherwise only kept up to date by trajectories, and so
+      // are recalculated over the likelihood blocks moved by this update
+      init_grad(s_ptr->update_block_loglike[b]);
+    }
+  }
+  
+  // update proposal covariances, which also act as the inverse mass matrices
+  // of trajectories
+  if (adapt_blocks) {
+    update_block_cov();
+  }
+  
+}
+
+//------------------------------------------------
+// Hamiltonian Monte Carlo trajectory over block b. Momenta are drawn in
+// whitened coordinates z, with phi = block_chol*z over the block, so that the
+// target is explored as if its covariance were the identity. The trajectory
+// is accepted or rejected as a whole, and is rejected outright if it leaves
+// the region in which theta can be represented. theta_prop and phi_prop must
+// equal theta and phi on entry, and do so again on return
+void Particle::update_block_hmc(int b, double beta) {
+  
+  const vector<int> &block = s_ptr->update_blocks[b];
+  const vector<vector<double>> &chol = block_chol[b];
+  int n = int(block.size());
+  int loglike_block_b = s_ptr->update_block_loglike[b];
+  double step = exp(adapt_blocks ? hmc_log_step[b] : hmc_log_step_bar[b]);
+  int n_steps = sample2(rng, 1, s_ptr->hmc_steps);
   
-  // transition probabilities
-  for (int i = 0; i < (s_ptr->max_indlevel_age + 1); ++i) {
-    ret += R::dbinom(s_ptr->p_AI_numer[i], s_ptr->p_AI_denom[i], p_AI[i], true);
-    ret += R::dbinom(s_ptr->p_AD_numer[i], s_ptr->p_AD_denom[i], p_AD[i], true);
-    ret += R::dbinom(s_ptr->p_ID_numer[i], s_ptr->p_ID_denom[i], p_ID[i], true);
-    ret += R::dbinom(s_ptr->p_SD_numer[i], s_ptr->p_SD_denom[i], p_SD[i], true);
+  // draw momenta, and get the whitened gradient of the log target at the
+  // current theta. Initial kinetic energy is subtracted, so that the final
+  // kinetic energy is added to it at the end of the trajectory
+  PROFILE_START(t_update);
+  double log_jacobian = 0.0;
+  double kinetic = 0.0;
+  for (int j = 0; j < n; ++j) {
+    int i = block[j];
+    hmc_momentum[j] = rnorm1(rng);
+    kinetic -= 0.5*hmc_momentum[j]*hmc_momentum[j];
+    hmc_grad[j] = get_phi_grad(i, theta, beta*grad_loglike[i] + grad_logprior[i], log_jacobian);
   }
+  double log_jacobian_prop = 0.0;
   
-  // duration m_AI
-  for (unsigned int j = 0; j < s_ptr->m_AI_count.size(); ++j) {
-    int tmp = s_ptr->m_AI_count[j];
-    if (tmp > 0) {
-      ret += tmp * log(get_delay_density(j, m_AI, s_AI));
+  // leapfrog steps, starting and ending with a half step in momentum
+  bool valid = true;
+  for (int step_i = 0; step_i <= n_steps; ++step_i) {
+    double step_momentum = ((step_i == 0) || (step_i == n_steps)) ? 0.5*step : step;
+    for (int k = 0; k < n; ++k) {
+      double grad_z = 0.0;
+      for (int j = k; j < n; ++j) {
+        grad_z += chol[j][k]*hmc_grad[j];
+      }
+      hmc_momentum[k] += step_momentum*grad_z;
+    }
+    if (step_i == n_steps) {
+      break;
+    }
+    
+    // full step in position
+    for (int j = 0; j < n; ++j) {
+      int i = block[j];
+      double velocity = 0.0;
+      for (int k = 0; k <= j; ++k) {
+        velocity += chol[j][k]*hmc_momentum[k];
+      }
+      phi_prop[i] += step*velocity;
+      phi_prop_to_theta_prop(i);
+      valid = valid && isfinite(theta_prop[i]);
+    }
+    if (!valid) {
+      break;
     }
+    
+    // gradient of the log target at the new position
+    loglike_prop = get_loglike_block(theta_prop, loglike_block_b, -1, &grad_loglike_prop[0]);
+    logprior_prop = get_logprior_grad(theta_prop, grad_logprior_prop);
+    log_jacobian_prop = 0.0;
+    for (int j = 0; j < n; ++j) {
+      int i = block[j];
+      hmc_grad[j] = get_phi_grad(i, theta_prop, beta*grad_loglike_prop[i] + grad_logprior_prop[i], log_jacobian_prop);
+    }
+  }
+  for (int j = 0; j < n; ++j) {
+    kinetic += 0.5*hmc_momentum[j]*hmc_momentum[j];
+  }
+  
+  // calculate Metropolis-Hastings ratio, counting trajectories that diverge
+  // as having zero acceptance probability
+  double MH = beta*(loglike_prop - loglike) + (logprior_prop - logprior) +
+    (log_jacobian_prop - log_jacobian) - kinetic;
+  if (!valid || !isfinite(MH)) {
+    MH = -INFINITY;
   }
   
-  // duration m_AD
-  for (unsigned int j = 0; j < s_ptr->m_AD_count.size(); ++j) {
-    int tmp = s_ptr->m_AD_count[j];
-    if (tmp > 0) {
-      ret += tmp * log(get_delay_density(j, m_AD, s_AD));
+  // accept or reject move
+  bool MH_accept = (log(runif_0_1(rng)) < MH);
+  
+  // implement changes
+  if (MH_accept) {
+    
+    // update theta and phi
+    for (int j = 0; j < n; ++j) {
+      theta[block[j]] = theta_prop[block[j]];
+      phi[block[j]] = phi_prop[block[j]];
     }
+    
+    // update likelihoods, along with the gradients of every parameter
+    // feeding into the recalculated likelihood blocks
+    loglike = loglike_prop;
+    logprior = logprior_prop;
+    accept_loglike();
+    for (int i = 0; i < d; ++i) {
+      if ((loglike_block_b < 0) || (s_ptr->param_block[i] == loglike_block_b)) {
+        grad_loglike[i] = grad_loglike_prop[i];
+        grad_logprior[i] = grad_logprior_prop[i];
+      }
+    }
+    
+    // add to acceptance rate count
+    accept_count++;
+    
+  } else {
+    
+    // reset theta_prop and phi_prop
+    for (int j = 0; j < n; ++j) {
+      theta_prop[block[j]] = theta[block[j]];
+      phi_prop[block[j]] = phi[block[j]];
+    }
+    
+  } // end MH step
+  
+  // dual averaging update of the step size
+  if (adapt_blocks) {
+    update_step_size(b, exp(fmin(MH, 0.0)));
+  }
+  
+  // each parameter in the block takes an equal share of the time
+#ifdef MARKOVID_PROFILE
+  for (int j = 0; j < n; ++j) {
+    PROFILE_PARAM(profile, block[j], MH_accept, t_update, 1.0/n);
+  }
+#endif
+  
+}
+
+//------------------------------------------------
+// dual averaging update of the step size of block b, given the acceptance
+// probability of the last trajectory, with the constants recommended by
+// Hoffman and Gelman (2014)
+void Particle::update_step_size(int b, double accept_prob) {
+  const double target = 0.8;
+  const double gamma = 0.05;
+  const double t0 = 10.0;
+  const double kappa = 0.75;
+  double t = block_index[b];
+  hmc_h_bar[b] += ((target - accept_prob) - hmc_h_bar[b]) / (t + t0);
+  hmc_log_step[b] = hmc_mu[b] - sqrt(t)/gamma*hmc_h_bar[b];
+  double w = pow(t, -kappa);
+  hmc_log_step_bar[b] = w*hmc_log_step[b] + (1 - w)*hmc_log_step_bar[b];
+  block_index[b]++;
+}
+
+//------------------------------------------------
+// delayed acceptance (Christen and Fox 2005) of a proposal to the spline nodes
+// of transition t, which must already be in theta_prop, with adjustment factor
+// adj. If k is non-negative then only node k differs from theta. The proposal
+// is first screened by an accept-reject step in which the surrogate
+// loglikelihood stands in for the exact loglikelihood. Only if it passes is
+// the exact loglikelihood calculated, and a second accept-reject step made
+// whose ratio corrects for the surrogate, so that the chain targets exactly
+// the same distribution as ordinary Metropolis-Hastings. Sets loglike_prop
+// and logprior_prop, and on acceptance commits the surrogate values of
+// transition t. Returns whether the proposal is accepted
+bool Particle::accept_delayed(int t, int k, int theta_i, double beta, double adj) {
+  
+  // bring surrogate values up to date with theta
+  if (!screen_valid) {
+    init_screen();
+  }
+  
+  // screen using the surrogate loglikelihood and the exact prior
+  double screen_prop = get_screen_loglike(theta_prop, t, k);
+  double screen_delta = beta*(screen_prop - screen_loglike[t]);
+  logprior_prop = get_logprior(theta_prop, theta_i);
+  double MH = screen_delta + (logprior_prop - logprior) + adj;
+  screen_count++;
+  if (!(log(runif_0_1(rng)) < MH)) {
+    return false;
+  }
+  screen_pass++;
+  
+  // correct using the exact loglikelihood
+  loglike_prop = get_loglike_block(theta_prop, t, k);
+  MH = beta*(loglike_prop - loglike) - screen_delta;
+  if (!(log(runif_0_1(rng)) < MH)) {
+    return false;
   }
   
-  // duration m_AC
-  for (unsigned int j = 0; j < s_ptr->m_AC_count.size(); ++j) {
-    int tmp = s_ptr->m_AC_count[j];
-    if (tmp > 0) {
-      ret += tmp * log(get_delay_density(j, m_AC, s_AC));
+  // commit surrogate values
+  screen_loglike[t] = screen_prop;
+  p_screen[t].swap(p_screen_prop[t]);
+  return true;
+}
+
+//------------------------------------------------
+// surrogate loglikelihood of the binomial data of transition t, pooled over
+// age bins, and excluding the log binomial coefficients, which cancel from
+// every ratio. Spline values over bins are written to p_screen_prop[t]. If k
+// is negative then they are recalculated from all nodes, and otherwise only
+// node k differs from the current theta, and they are updated from p_screen
+double Particle::get_screen_loglike(vector<double> &theta, int t, int k) {
+  
+  int n_node = s_ptr->n_node;
+  int n_screen = s_ptr->n_screen[t];
+  const double *node = &theta[t*n_node];
+  const double *basis = s_ptr->screen_basis[t].data();
+  double *spline = p_screen_prop[t].data();
+  
+  // get spline values over bins
+  if (k < 0) {
+    s_ptr->spline_kernel(basis, node, n_node, n_screen, spline);
+  } else {
+    const double *col = basis + k*n_screen;
+    const double *spline_curr = p_screen[t].data();
+    double delta = node[k] - p_node[t][k];
+    for (int i = 0; i < n_screen; ++i) {
+      spline[i] = spline_curr[i] + col[i]*delta;
     }
   }
   
-  // duration m_ID
-  for (unsigned int j = 0; j < s_ptr->m_ID_count.size(); ++j) {
-    int tmp = s_ptr->m_ID_count[j];
-    if (tmp > 0) {
-      ret += tmp * log(get_delay_density(j, m_ID, s_ID));
+  // binomial likelihood over bins, as in get_loglike_transition()
+  const double *numer = s_ptr->screen_numer[t].data();
+  const double *denom = s_ptr->screen_denom[t].data();
+  double ret = 0.0;
+#ifdef _OPENMP
+#pragma omp simd reduction(+:ret)
+#endif
+  for (int i = 0; i < n_screen; ++i) {
+    double x = spline[i];
+    double softplus = fmax(x, 0.0) + log1p(exp(-fabs(x)));
+    ret += numer[i]*x - denom[i]*softplus;
+  }
+  
+  return ret;
+}
+
+//------------------------------------------------
+// recalculate surrogate values of every transition at the current theta
+void Particle::init_screen() {
+  for (int t = 0; t < s_ptr->n_trans; ++t) {
+    screen_loglike[t] = get_screen_loglike(theta, t, -1);
+    p_screen[t].swap(p_screen_prop[t]);
+  }
+  screen_valid = true;
+}
+
+//------------------------------------------------
+// discard the running covariance of each block, keeping the current proposal
+// Cholesky factors until a new estimate has accumulated
+void Particle::reset_block_cov() {
+  cov_n = 0;
+  for (unsigned int b = 0; b < block_mean.size(); ++b) {
+    fill(block_mean[b].begin(), block_mean[b].end(), 0.0);
+    for (unsigned int j = 0; j < block_sumsq[b].size(); ++j) {
+      fill(block_sumsq[b][j].begin(), block_sumsq[b][j].end(), 0.0);
     }
   }
   
-  // duration m_I1S
-  for (unsigned int j = 0; j < s_ptr->m_I1S_count.size(); ++j) {
-    int tmp = s_ptr->m_I1S_count[j];
-    if (tmp > 0) {
-      ret += tmp * log(get_delay_density(j, m_I1S, s_I1S));
+  // dual averaging of Hamiltonian Monte Carlo step sizes restarts from the
+  // current step sizes, as the mass matrix is about to change
+  if (s_ptr->hmc_update) {
+    for (unsigned int b = 0; b < block_mean.size(); ++b) {
+      if (!s_ptr->update_block_hmc[b]) {
+        continue;
+      }
+      hmc_mu[b] = log(10.0) + hmc_log_step[b];
+      hmc_log_step_bar[b] = 0.0;
+      hmc_h_bar[b] = 0.0;
+      block_index[b] = 1;
     }
   }
+}
+
+//------------------------------------------------
+// add the current phi to the running covariance of each block, and
+// recalculate proposal Cholesky factors once there are at least 10 iterations
+// per parameter in the block. A small ridge keeps the covariance positive
+// definite, and the previous factor is kept if the decomposition fails. The
+// decomposition is done in place, so block_cov is scratch space
+void Particle::update_block_cov() {
   
-  // duration m_I2S
-  for (unsigned int j = 0; j < s_ptr->m_I2S_count.size(); ++j) {
-    int tmp = s_ptr->m_I2S_count[j];
-    if (tmp > 0) {
-      ret += tmp * log(get_delay_density(j, m_I2S, s_I2S));
+  cov_n++;
+  int n_blocks = int(s_ptr->update_blocks.size());
+  for (int b = 0; b < n_blocks; ++b) {
+    const vector<int> &block = s_ptr->update_blocks[b];
+    int n = int(block.size());
+    
+    // Welford update of mean and sums of squared deviations
+    for (int j = 0; j < n; ++j) {
+      block_phi[b][j] = phi[block[j]] - block_mean[b][j];
+      block_mean[b][j] += block_phi[b][j] / cov_n;
     }
+    for (int j = 0; j < n; ++j) {
+      double dev_j = phi[block[j]] - block_mean[b][j];
+      for (int k = 0; k <= j; ++k) {
+        block_sumsq[b][j][k] += block_phi[b][k]*dev_j;
+      }
+    }
+    
+    // recalculate Cholesky factor
+    if (cov_n < 10*n) {
+      continue;
+    }
+    for (int j = 0; j < n; ++j) {
+      for (int k = 0; k <= j; ++k) {
+        block_cov[b][j][k] = block_sumsq[b][j][k] / (cov_n - 1);
+      }
+      block_cov[b][j][j] += 1e-6;
+    }
+    cholesky(block_cov[b], block_cov[b]);
+    bool valid = true;
+    for (int j = 0; j < n; ++j) {
+      valid = valid && (block_cov[b][j][j] > 0);
+    }
+    if (valid) {
+      block_chol[b].swap(block_cov[b]);
+    }
+  }
+  
+}
+
+//------------------------------------------------
+// define cpp loglike function. If theta_i is negative then every block of the
+// likelihood is recalculated. Otherwise only the block that depends on
+// theta[theta_i] is recalculated, and all other blocks are taken from their
+// values at the current theta. Recalculated blocks are stored in
+// loglike_block_prop until committed by accept_loglike()
+double Particle::get_loglike(vector<double> &theta, int theta_i) {
+  if (theta_i < 0) {
+    return get_loglike_block(theta, -1, -1);
   }
+  int b = s_ptr->param_block[theta_i];
+  int k = (b < s_ptr->n_trans) ? theta_i % s_ptr->n_node : -1;
+  return get_loglike_block(theta, b, k);
+}
+
+//------------------------------------------------
+// loglikelihood with only the given block recalculated, or every block if
+// block is negative. For transition blocks, k gives the only spline node that differs
+// from the current theta, or is negative if any node may differ
+double Particle::get_loglike_block(vector<double> &theta, int block, int k, double *grad) {
   
-  // duration m_SD
-  for (unsigned int j = 0; j < s_ptr->m_SD_count.size(); ++j) {
-    int tmp = s_ptr->m_SD_count[j];
-    if (tmp > 0) {
-      ret += tmp * log(get_delay_density(j, m_SD, s_SD));
+  // recalculate the block(s) affected
+  block_prop = block;
+  for (int b = 0; b < s_ptr->n_block; ++b) {
+    if ((block_prop >= 0) && (b != block_prop)) {
+      continue;
+    }
+    if (b < s_ptr->n_trans) {
+      loglike_block_prop[b] = get_loglike_transition(theta, b, (block_prop < 0) ? -1 : k, grad);
+    } else {
+      PROFILE_START(t_duration);
+      loglike_block_prop[b] = get_loglike_duration(theta, b - s_ptr->n_trans, grad);
+      PROFILE_STOP(profile, PROFILE_DURATION, t_duration);
     }
   }
   
-  // duration m_SC
-  for (unsigned int j = 0; j < s_ptr->m_SC_count.size(); ++j) {
-    int tmp = s_ptr->m_SC_count[j];
-    if (tmp > 0) {
-      ret += tmp * log(get_delay_density(j, m_SC, s_SC));
+  // sum over blocks, using cached values for blocks that were not recalculated
+  double ret = 0.0;
+  for (int b = 0; b < s_ptr->n_block; ++b) {
+    if ((block_prop >= 0) && (b != block_prop)) {
+      ret += loglike_block[b];
+    } else {
+      ret += loglike_block_prop[b];
     }
   }
   
   if (!isfinite(ret)) {
-    //print(i, s_ptr->p_AI_denom[i], s_ptr->p_AI_numer[i], p_AI[i], ret);
-    Rcpp::stop("ret non finite");
+    throw runtime_error("ret non finite");
   }
   
   // ----------------------------------------------------------------
@@ -364,90 +767,292 @@ double Particle::get_loglike(vector<double> &theta, int theta_i) {
   return ret;
 }
 
-
 //------------------------------------------------
-// define cpp logprior function
-double Particle::get_logprior(vector<double> &theta, int theta_i) {
+// loglikelihood of the individual-level transition data for transition t. If
+// k is negative then the spline is recalculated from all nodes, by the kernel
+// specialised for n_node, otherwise only node k differs from the current theta
+// and the spline is updated by adding the corresponding column of the basis
+// matrix. If grad is given then the derivative with respect to each node is
+// also found, by projecting the residuals k - n*p over ages back onto the basis
+double Particle::get_loglike_transition(vector<double> &theta, int t, int k, double *grad) {
   
-  // ----------------------------------------------------------------
-  // unpack parameters
+  int n_node = s_ptr->n_node;
+  int n_age = s_ptr->n_age;
+  const double *node = &theta[t*n_node];
+  const double *basis = &s_ptr->spline_basis[0];
+  double *spline = &p_spline_prop[t][0];
   
-  // transition cubic spline nodes
-  int pi = 0;
-  for (int i = 0; i < s_ptr->n_node; ++i) {
-    p_AI_node[i] = theta[pi++];
+  // get spline values over ages
+  PROFILE_START(t_spline);
+  if (k < 0) {
+    s_ptr->spline_kernel(basis, node, n_node, n_age, spline);
+  } else {
+    const double *col = basis + k*n_age;
+    const double *spline_curr = &p_spline[t][0];
+    double delta = node[k] - p_node[t][k];
+    for (int i = 0; i < n_age; ++i) {
+      spline[i] = spline_curr[i] + col[i]*delta;
+    }
   }
-  for (int i = 0; i < s_ptr->n_node; ++i) {
-    p_AD_node[i] = theta[pi++];
+  PROFILE_STOP(profile, PROFILE_SPLINE, t_spline);
+  
+  // binomial likelihood over ages, fused with the logistic transform. With
+  // p = 1/(1+exp(-x)) the log-likelihood is k*x - n*log(1+exp(x)) plus the
+  // precomputed log binomial coefficient, where log(1+exp(x)) is evaluated in
+  // the overflow-safe form max(x,0) + log1p(exp(-|x|))
+  PROFILE_START(t_binomial);
+  int offset = t*n_age;
+  const double *numer = &s_ptr->trans_numer[offset];
+  const double *denom = &s_ptr->trans_denom[offset];
+  const double *lchoose = &s_ptr->trans_lchoose[offset];
+  double ret = 0.0;
+  if (grad == nullptr) {
+#ifdef _OPENMP
+#pragma omp simd reduction(+:ret)
+#endif
+    for (int i = 0; i < n_age; ++i) {
+      double x = spline[i];
+      double softplus = fmax(x, 0.0) + log1p(exp(-fabs(x)));
+      ret += lchoose[i] + numer[i]*x - denom[i]*softplus;
+    }
+  } else {
+    double *resid = &trans_resid[0];
+#ifdef _OPENMP
+#pragma omp simd reduction(+:ret)
+#endif
+    for (int i = 0; i < n_age; ++i) {
+      double x = spline[i];
+      double e = exp(-fabs(x));
+      double softplus = fmax(x, 0.0) + log1p(e);
+      ret += lchoose[i] + numer[i]*x - denom[i]*softplus;
+      double p = (x >= 0) ? 1.0/(1.0 + e) : e/(1.0 + e);
+      resid[i] = numer[i] - denom[i]*p;
+    }
+    for (int j = 0; j < n_node; ++j) {
+      const double *col = basis + j*n_age;
+      double g = 0.0;
+      for (int i = 0; i < n_age; ++i) {
+        g += col[i]*resid[i];
+      }
+      grad[t*n_node + j] = g;
+    }
+  }
+  PROFILE_STOP(profile, PROFILE_BINOMIAL, t_binomial);
+  
+  return ret;
+}
+
+//------------------------------------------------
+// loglikelihood of the individual-level duration data for duration j. If grad
+// is given then the derivatives with respect to the mean and shape are also
+// found
+double Particle::get_loglike_duration(vector<double> &theta, int j, double *grad) {
+  
+  // unpack mean and Erlang shape
+  double m = theta[m_offset + j];
+  double s = theta[s_offset + j];
+  
+  // sum over nonzero days only
+  double ret = 0.0;
+  const vector<int> &day = s_ptr->m_day[j];
+  const vector<int> &count = s_ptr->m_day_count[j];
+  int n_day = int(day.size());
+#ifdef USE_LOOKUP
+  if (grad == nullptr) {
+    ret = s_ptr->lookup_ptr->get_loglike(m, s, day.data(), count.data(), s_ptr->m_n_lookup[j], n_day);
+  } else {
+    ret = s_ptr->lookup_ptr->get_loglike_grad(m, s, day.data(), count.data(), s_ptr->m_n_lookup[j], n_day,
+                                              grad[m_offset + j], grad[s_offset + j]);
   }
-  for (int i = 0; i < s_ptr->n_node; ++i) {
-    p_ID_node[i] = theta[pi++];
+#else
+  for (int k = 0; k < n_day; ++k) {
+    ret += count[k] * get_delay_logdensity(day[k], m, s);
   }
-  for (int i = 0; i < s_ptr->n_node; ++i) {
-    p_SD_node[i] = theta[pi++];
+  if (grad != nullptr) {
+    grad[m_offset + j] = 0.0;
+    grad[s_offset + j] = 0.0;
+    for (int k = 0; k < n_day; ++k) {
+      double d_m, d_s;
+      s_ptr->lookup_ptr->get_log_density_exact_grad(day[k], m, s, d_m, d_s);
+      grad[m_offset + j] += count[k] * d_m;
+      grad[s_offset + j] += count[k] * d_s;
+    }
   }
+#endif
   
+  return ret;
+}
+
+//------------------------------------------------
+// commit the likelihood blocks recalculated under the last proposal. Must be
+// called after theta has been updated to the accepted value
+void Particle::accept_loglike() {
+  int n_node = s_ptr->n_node;
+  for (int b = 0; b < s_ptr->n_block; ++b) {
+    if ((block_prop >= 0) && (b != block_prop)) {
+      continue;
+    }
+    loglike_block[b] = loglike_block_prop[b];
+    
+    // store spline nodes and values of transitions
+    if (b < s_ptr->n_trans) {
+      copy(theta.begin() + b*n_node, theta.begin() + (b+1)*n_node, p_node[b].begin());
+      p_spline[b].swap(p_spline_prop[b]);
+    }
+  }
+}
+
+
+//------------------------------------------------
+// define cpp logprior function
+double Particle::get_logprior(vector<double> &theta, int theta_i) {
   
   // ----------------------------------------------------------------
   // apply transformations and priors
   
   double k = 0.5;  // smoothing parameter
   double ret = 0.0;
+  PROFILE_START(t_logprior);
   
-  for (int i = 0; i < s_ptr->n_node; ++i) {
-    if (i == 0) {
-      ret += -p_AI_node[i] -2*log(1 + exp(-p_AI_node[i]));
-    } else {
-      ret += R::dnorm(p_AI_node[i], p_AI_node[i-1], k, true);
+  // random walk prior over the spline nodes of each transition
+  int n_node = s_ptr->n_node;
+  for (int t = 0; t < s_ptr->n_trans; ++t) {
+    const double *node = &theta[t*n_node];
+    for (int i = 0; i < n_node; ++i) {
+      if (i == 0) {
+        ret += -node[i] -2*log(1 + exp(-node[i]));
+      } else {
+        ret += R::dnorm(node[i], node[i-1], k, true);
+      }
     }
   }
-  for (int i = 0; i < s_ptr->n_node; ++i) {
-    if (i == 0) {
-      ret += -p_AD_node[i] -2*log(1 + exp(-p_AD_node[i]));
-    } else {
-      ret += R::dnorm(p_AD_node[i], p_AD_node[i-1], k, true);
-    }
-  }
-  for (int i = 0; i < s_ptr->n_node; ++i) {
-    if (i == 0) {
-      ret += -p_ID_node[i] -2*log(1 + exp(-p_ID_node[i]));
-    } else {
-      ret += R::dnorm(p_ID_node[i], p_ID_node[i-1], k, true);
-    }
-  }
-  for (int i = 0; i < s_ptr->n_node; ++i) {
-    if (i == 0) {
-      ret += -p_SD_node[i] -2*log(1 + exp(-p_SD_node[i]));
-    } else {
-      ret += R::dnorm(p_SD_node[i], p_SD_node[i-1], k, true);
+  PROFILE_STOP(profile, PROFILE_LOGPRIOR, t_logprior);
+  
+  return ret;
+}
+
+//------------------------------------------------
+// logprior as in get_logprior(), along with its gradient with respect to
+// theta. Parameters other than spline nodes have flat priors, and so zero
+// gradient
+double Particle::get_logprior_grad(vector<double> &theta, vector<double> &grad) {
+  
+  double k = 0.5;  // smoothing parameter
+  double ret = 0.0;
+  PROFILE_START(t_logprior);
+  
+  // random walk prior over the spline nodes of each transition. The first node
+  // has a standard logistic prior
+  int n_node = s_ptr->n_node;
+  fill(grad.begin(), grad.end(), 0.0);
+  for (int t = 0; t < s_ptr->n_trans; ++t) {
+    const double *node = &theta[t*n_node];
+    double *node_grad = &grad[t*n_node];
+    for (int i = 0; i < n_node; ++i) {
+      if (i == 0) {
+        ret += -node[i] -2*log(1 + exp(-node[i]));
+        double e = exp(-fabs(node[i]));
+        double p = (node[i] >= 0) ? 1.0/(1.0 + e) : e/(1.0 + e);
+        node_grad[i] += 1 - 2*p;
+      } else {
+        ret += R::dnorm(node[i], node[i-1], k, true);
+        double slope = (node[i] - node[i-1]) / (k*k);
+        node_grad[i] -= slope;
+        node_grad[i-1] += slope;
+      }
     }
   }
+  PROFILE_STOP(profile, PROFILE_LOGPRIOR, t_logprior);
   
   return ret;
 }
 
 //------------------------------------------------
-// get density of delay distribution on day x
-double Particle::get_delay_density(int x, double m, double s) {
-#define USE_LOOKUP
+// recalculate the loglikelihood and logprior at the current theta along with
+// their gradients, as needed at the start of the first Hamiltonian Monte Carlo
+// trajectory, and after any other accepted move. Only the given likelihood
+// block is recalculated, or every block if block is negative. Values are
+// recalculated in the same way as under proposals
+void Particle::init_grad(int block) {
+  loglike = get_loglike_block(theta, block, -1, &grad_loglike[0]);
+  accept_loglike();
+  logprior = get_logprior_grad(theta, grad_logprior);
+}
+
+//------------------------------------------------
+// get log-density of delay distribution on day x
+double Particle::get_delay_logdensity(int x, double m, double s) {
 #ifdef USE_LOOKUP
-  int m_index = floor(m * 100);
-  int s_index = floor(s);
-  if ((m_index < 0) || (m_index > 2000) || (s_index < 0) || (s_index > 9) || (x < 0)) {
-    print("get_delay_density outside lookup range");
-    print(x, m, s, m_index, s_index);
-    Rcpp::stop("");
-  }
-  if (x > 100) {
-    return 1e-200;
-  }
-  return s_ptr->gamma_density_lookup[m_index][s_index][x];
+  return s_ptr->lookup_ptr->get_log_density(x, m, s);
 #else
-  double ret = R::pgamma(x + 1, s, m/s, true, false) - R::pgamma(x, s, m/s, true, false);
-  if (ret < 1e-200) {
-    ret = 1e-200;
-  }
-  return ret;
+  return s_ptr->lookup_ptr->get_log_density_exact(x, m, s);
 #endif
 }
 
+//------------------------------------------------
+// write complete particle state, including adaptive proposal parameters,
+// surrogate values and the state of the random number stream
+void Particle::save_state(CheckpointWriter &writer) {
+  writer.write(theta);
+  writer.write(phi);
+  writer.write(bw);
+  writer.write(bw_index);
+  writer.write(loglike);
+  writer.write(logprior);
+  writer.write(loglike_block);
+  writer.write(p_node);
+  writer.write(p_spline);
+  writer.write(accept_count);
+  writer.write_array(rng.state, 4);
+  writer.write(block_mean);
+  writer.write(block_sumsq);
+  writer.write(block_chol);
+  writer.write(block_scale);
+  writer.write(block_index);
+  writer.write(cov_n);
+  writer.write(adapt_blocks);
+  writer.write(hmc_log_step);
+  writer.write(hmc_log_step_bar);
+  writer.write(hmc_h_bar);
+  writer.write(hmc_mu);
+  writer.write(p_screen);
+  writer.write(screen_loglike);
+  writer.write(screen_valid);
+}
+
+//------------------------------------------------
+// restore particle state written by save_state(). The particle must already
+// have been initialised with the same system object
+void Particle::load_state(CheckpointReader &reader) {
+  reader.read(theta);
+  reader.read(phi);
+  reader.read(bw);
+  reader.read(bw_index);
+  reader.read(loglike);
+  reader.read(logprior);
+  reader.read(loglike_block);
+  reader.read(p_node);
+  reader.read(p_spline);
+  reader.read(accept_count);
+  reader.read_array(rng.state, 4);
+  reader.read(block_mean);
+  reader.read(block_sumsq);
+  reader.read(block_chol);
+  reader.read(block_scale);
+  reader.read(block_index);
+  reader.read(cov_n);
+  reader.read(adapt_blocks);
+  reader.read(hmc_log_step);
+  reader.read(hmc_log_step_bar);
+  reader.read(hmc_h_bar);
+  reader.read(hmc_mu);
+  reader.read(p_screen);
+  reader.read(screen_loglike);
+  reader.read(screen_valid);
+  
+  // gradients at the current theta are not stored, and are recalculated
+  // exactly as they were found originally
+  if (s_ptr->hmc_update) {
+    init_grad();
+  }
+}
@@ -4,8 +4,10 @@
 #include "System.h"
 #include "misc_v10.h"
 #include "probability_v10.h"
+#include "Checkpoint.h"
+#include "Profile.h"
 
-#include <Rcpp.h>
+#include <stdexcept>
 
 //------------------------------------------------
 // class defining MCMC particle
@@ -20,38 +22,16 @@ public:
   // local copies of some parameters for convenience
   int d;
   
-  // vector over ages for cubic splines
-  std::vector<double> age_seq;
-  
-  // transition probabilities
-  std::vector<double> p_AI_node;
-  std::vector<double> p_AI;
-  std::vector<double> p_AD_node;
-  std::vector<double> p_AD;
-  std::vector<double> p_ID_node;
-  std::vector<double> p_ID;
-  std::vector<double> p_SD_node;
-  std::vector<double> p_SD;
-  
-  // mean durations
-  double m_AI;
-  double m_AD;
-  double m_AC;
-  double m_ID;
-  double m_I1S;
-  double m_I2S;
-  double m_SD;
-  double m_SC;
-  
-  // Erlang scale of durations
-  double s_AI;
-  double s_AD;
-  double s_AC;
-  double s_ID;
-  double s_I1S;
-  double s_I2S;
-  double s_SD;
-  double s_SC;
+  // transition spline nodes and spline values over ages at the current theta,
+  // one vector per transition. p_spline_prop holds spline values under the
+  // last proposal
+  std::vector<std::vector<double>> p_node;
+  std::vector<std::vector<double>> p_spline;
+  std::vector<std::vector<double>> p_spline_prop;
+  
+  // position in theta of the first mean duration and first Erlang shape
+  int m_offset;
+  int s_offset;
   
   // theta is the parameter vector in natural space
   std::vector<double> theta;
@@ -66,15 +46,93 @@ public:
   std::vector<int> bw_index;
   double bw_stepsize;
   
+  // adaptive block proposals, one entry per update block. Proposals are drawn
+  // in phi space from a multivariate normal centred on the current values, with
+  // covariance equal to the squared block scale times the running covariance
+  // of phi over the second half of burn-in. The running covariance is held as a mean and a lower
+  // triangle of sums of squared deviations, updated by Welford's algorithm, and
+  // block_chol holds the Cholesky factor of the proposal covariance, with
+  // block_cov used as scratch space. Until enough iterations have accumulated
+  // the identity matrix is used instead
+  std::vector<std::vector<double>> block_mean;
+  std::vector<std::vector<std::vector<double>>> block_sumsq;
+  std::vector<std::vector<std::vector<double>>> block_cov;
+  std::vector<std::vector<std::vector<double>>> block_chol;
+  std::vector<std::vector<double>> block_phi;
+  std::vector<std::vector<double>> block_phi_prop;
+  std::vector<double> block_scale;
+  std::vector<int> block_index;
+  int cov_n;
+  bool adapt_blocks;
+  
+  // Hamiltonian Monte Carlo proposals, one trajectory per update block
+  // flagged in update_block_hmc of the system object. Each trajectory takes a number of leapfrog steps drawn uniformly from 1 to
+  // hmc_steps, in phi coordinates whitened by block_chol, so that the running
+  // covariance learned for block proposals acts as the inverse mass matrix.
+  // Step sizes are tuned by the dual averaging of Hoffman and Gelman (2014)
+  // toward an acceptance rate of 0.8 while adapt_blocks is true, and are then
+  // fixed at their averaged values. hmc_log_step holds the current log step
+  // size of each block, hmc_log_step_bar the averaged log step size,
+  // hmc_h_bar the averaged shortfall in acceptance rate, and hmc_mu the value
+  // toward which log step sizes are shrunk. block_index counts adaptation
+  // steps
+  std::vector<double> hmc_log_step;
+  std::vector<double> hmc_log_step_bar;
+  std::vector<double> hmc_h_bar;
+  std::vector<double> hmc_mu;
+  
+  // gradients of the loglikelihood and logprior with respect to theta, at the
+  // current theta and under the last proposal. Only entries feeding into
+  // recalculated likelihood blocks are written under a proposal. Momenta,
+  // whitened gradients and binomial residuals over ages are scratch space
+  std::vector<double> grad_loglike;
+  std::vector<double> grad_logprior;
+  std::vector<double> grad_loglike_prop;
+  std::vector<double> grad_logprior_prop;
+  std::vector<double> hmc_momentum;
+  std::vector<double> hmc_grad;
+  std::vector<double> trans_resid;
+  
+  // delayed acceptance. p_screen holds the surrogate spline values over the
+  // age bins of each transition at the current theta, and p_screen_prop those
+  // under the last screened proposal. screen_loglike holds the surrogate
+  // loglikelihood of each transition at the current theta. These are kept up
+  // to date only while screen_valid is true, and are otherwise recalculated
+  // before the next screened proposal. screen_count and screen_pass count the
+  // screened proposals, and those passing the screen, since they were last
+  // collected by the chain
+  std::vector<std::vector<double>> p_screen;
+  std::vector<std::vector<double>> p_screen_prop;
+  std::vector<double> screen_loglike;
+  bool screen_valid;
+  int screen_count;
+  int screen_pass;
+  
   // likelihoods and priors
   double loglike;
   double loglike_prop;
+  
+  // loglikelihood broken down into independent blocks (transitions followed
+  // by durations). loglike_block stores values at the current theta, and
+  // loglike_block_prop stores values recalculated under the last proposal. If
+  // block_prop is negative then all blocks were recalculated
+  std::vector<double> loglike_block;
+  std::vector<double> loglike_block_prop;
+  int block_prop;
   double logprior;
   double logprior_prop;
   
   // store acceptance rates
   int accept_count;
   
+  // random number generator. Each particle draws from its own stream
+  RNG rng;
+  
+  // evaluation counts and timings, when compiled with profiling
+#ifdef MARKOVID_PROFILE
+  Profile profile;
+#endif
+  
   
   // PUBLIC FUNCTIONS
   
@@ -82,19 +140,51 @@ public:
   Particle() {};
   
   // initialise
-  void init(System &s);
-  
-  // update theta[i] via univariate Metropolis-Hastings
-  void update(double beta);
-  
-  // loglikelihood and logprior
+  void init(System &s, const RNG &rng);
+  
+  // update theta, either via univariate or block Metropolis-Hastings, or via
+  // Hamiltonian Monte Carlo. If delayed is true then Metropolis-Hastings
+  // proposals to spline nodes are made by delayed acceptance
+  void update(double beta, bool delayed = false);
+  void update_univar(double beta, bool delayed = false);
+  void update_block(double beta, bool delayed = false);
+  void update_hmc(double beta);
+  bool update_block_mh(int b, double beta, bool delayed = false);
+  void update_block_hmc(int b, double beta);
+  void update_block_cov();
+  void reset_block_cov();
+  void update_step_size(int b, double accept_prob);
+  
+  // delayed acceptance of a proposal to the spline nodes of one transition,
+  // screened by the surrogate loglikelihood
+  bool accept_delayed(int t, int k, int theta_i, double beta, double adj);
+  double get_screen_loglike(std::vector<double> &theta, int t, int k);
+  void init_screen();
+  
+  // loglikelihood and logprior. Where grad is given, gradients with respect to
+  // theta of the blocks that are recalculated are also written into it
   double get_loglike(std::vector<double> &theta, int theta_i);
+  double get_loglike_block(std::vector<double> &theta, int block, int k,
+                           double *grad = nullptr);
+  double get_loglike_transition(std::vector<double> &theta, int t, int k,
+                                double *grad = nullptr);
+  double get_loglike_duration(std::vector<double> &theta, int j,
+                              double *grad = nullptr);
+  void accept_loglike();
   double get_logprior(std::vector<double> &theta, int theta_i);
+  double get_logprior_grad(std::vector<double> &theta, std::vector<double> &grad);
+  void init_grad(int block = -1);
   
   // other public methods
-  double get_delay_density(int x, double m, double s);
+  double get_delay_logdensity(int x, double m, double s);
   void phi_prop_to_theta_prop(int i);
   void theta_to_phi();
   double get_adjustment(int i);
+  double get_phi_grad(int i, const std::vector<double> &theta, double grad,
+                      double &log_jacobian);
+  
+  // save and restore complete particle state
+  void save_state(CheckpointWriter &writer);
+  void load_state(CheckpointReader &reader);
   
 };
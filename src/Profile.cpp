@@ -0,0 +1,28 @@
+
+#include "Profile.h"
+
+using namespace std;
+
+//------------------------------------------------
+// zero all counts for d parameters
+void Profile::init(int d) {
+  calls = vector<int64_t>(N_PROFILE);
+  seconds = vector<double>(N_PROFILE);
+  param_proposals = vector<int64_t>(d);
+  param_accepts = vector<int64_t>(d);
+  param_seconds = vector<double>(d);
+}
+
+//------------------------------------------------
+// add all counts of another object to this one
+void Profile::merge(const Profile &other) {
+  for (int k = 0; k < N_PROFILE; ++k) {
+    calls[k] += other.calls[k];
+    seconds[k] += other.seconds[k];
+  }
+  for (unsigned int i = 0; i < param_proposals.size(); ++i) {
+    param_proposals[i] += other.param_proposals[i];
+    param_accepts[i] += other.param_accepts[i];
+    param_seconds[i] += other.param_seconds[i];
+  }
+}
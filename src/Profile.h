@@ -0,0 +1,74 @@
+
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+
+// components of the sampler that are timed when profiling
+enum {PROFILE_SPLINE, PROFILE_BINOMIAL, PROFILE_DURATION, PROFILE_LOGPRIOR,
+      PROFILE_COUPLING, PROFILE_PROGRESS, N_PROFILE};
+
+//------------------------------------------------
+// class holding evaluation counts and wall times of the main components of the
+// sampler, along with proposal counts, acceptances and time spent per free
+// parameter. Each particle and chain owns its own object, so no
+// synchronisation is needed, and objects are summed once chains have
+// finished. Objects are only filled in when the package is compiled with
+// -DMARKOVID_PROFILE, through the PROFILE_ macros below, which otherwise
+// expand to nothing
+class Profile {
+  
+public:
+  // PUBLIC OBJECTS
+  
+  typedef std::chrono::steady_clock clock;
+  
+  // calls and seconds per component
+  std::vector<int64_t> calls;
+  std::vector<double> seconds;
+  
+  // proposals, acceptances and seconds per parameter
+  std::vector<int64_t> param_proposals;
+  std::vector<int64_t> param_accepts;
+  std::vector<double> param_seconds;
+  
+  
+  // PUBLIC FUNCTIONS
+  
+  // constructors
+  Profile() {};
+  
+  // zero all counts for d parameters
+  void init(int d);
+  
+  // add the time since t0 to a component
+  void add(int component, clock::time_point t0) {
+    calls[component]++;
+    seconds[component] += std::chrono::duration<double>(clock::now() - t0).count();
+  }
+  
+  // add a proposal to parameter i, taking the given share of the time since t0
+  void add_param(int i, bool accept, clock::time_point t0, double share = 1.0) {
+    param_proposals[i]++;
+    param_accepts[i] += accept;
+    param_seconds[i] += share*std::chrono::duration<double>(clock::now() - t0).count();
+  }
+  
+  // add all counts of another object to this one
+  void merge(const Profile &other);
+  
+};
+
+//------------------------------------------------
+// macros used to instrument the sampler. PROFILE_START declares a time point
+// named t0, which PROFILE_STOP and PROFILE_PARAM then measure from
+#ifdef MARKOVID_PROFILE
+#define PROFILE_START(t0) Profile::clock::time_point t0 = Profile::clock::now()
+#define PROFILE_STOP(profile, component, t0) (profile).add(component, t0)
+#define PROFILE_PARAM(profile, i, accept, t0, share) (profile).add_param(i, accept, t0, share)
+#else
+#define PROFILE_START(t0)
+#define PROFILE_STOP(profile, component, t0)
+#define PROFILE_PARAM(profile, i, accept, t0, share)
+#endif
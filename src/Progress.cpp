@@ -0,0 +1,160 @@
+
+#include "Progress.h"
+
+#ifdef MARKOVID_STANDALONE
+#include <csignal>
+#include <iostream>
+#else
+#include <Rcpp.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+using namespace std;
+
+// time between polls of the main thread
+static const chrono::milliseconds POLL_INTERVAL(100);
+
+#ifdef MARKOVID_STANDALONE
+// raised by the signal handler, and read by the main thread when polling
+static volatile sig_atomic_t signal_received = 0;
+
+static void handle_signal(int) {
+  signal_received = 1;
+}
+
+//------------------------------------------------
+// treat SIGINT and SIGTERM as user interrupts
+void catch_interrupt_signals() {
+  signal(SIGINT, handle_signal);
+  signal(SIGTERM, handle_signal);
+}
+#endif
+
+//------------------------------------------------
+// set up counters of all tasks
+Progress::Progress(const vector<int> &total, bool draw_bar, bool markdown) {
+  this->total = total;
+  done = unique_ptr<atomic<int>[]>(new atomic<int>[total.size()]);
+  for (unsigned int t = 0; t < total.size(); ++t) {
+    done[t].store(0);
+  }
+  n_finished.store(0);
+  interrupted.store(false);
+  this->draw_bar = draw_bar;
+  this->markdown = markdown;
+  last_drawn = -1;
+  main_id = this_thread::get_id();
+  last_poll = chrono::steady_clock::now();
+}
+
+//------------------------------------------------
+// mark a task as finished, whether or not all of its iterations were run
+void Progress::finish(int /*task*/) {
+  n_finished.fetch_add(1);
+  if (this_thread::get_id() == main_id) {
+    poll(true);
+  }
+}
+
+//------------------------------------------------
+// redraw the progress bar and check for user interrupts, at most once per
+// polling interval unless forced
+void Progress::poll(bool force) {
+  chrono::steady_clock::time_point now = chrono::steady_clock::now();
+  if (!force && (now - last_poll < POLL_INTERVAL)) {
+    return;
+  }
+  last_poll = now;
+  
+  // an interrupt is caught here rather than propagated, so that all tasks can
+  // stop cleanly before the interrupt is passed back to R
+#ifdef MARKOVID_STANDALONE
+  if (signal_received) {
+    interrupted.store(true);
+  }
+#else
+  try {
+    Rcpp::checkUserInterrupt();
+  } catch (Rcpp::internal::InterruptedException &e) {
+    interrupted.store(true);
+  }
+#endif
+  
+  if (draw_bar) {
+    draw();
+  }
+}
+
+//------------------------------------------------
+// poll until every task has finished
+void Progress::wait() {
+  while (n_finished.load() < int(total.size())) {
+    this_thread::sleep_for(POLL_INTERVAL / 4);
+    poll();
+  }
+  poll(true);
+}
+
+//------------------------------------------------
+// draw a single bar over the iterations of all tasks, in the style of
+// txtProgressBar(), followed by the percentage complete of each task when
+// there are only a few of them
+void Progress::draw() {
+  
+  // the completed bar is only drawn once
+  if (last_drawn > 100) {
+    return;
+  }
+  
+  int n_task = int(total.size());
+  double sum_done = 0.0;
+  double sum_total = 0.0;
+  for (int t = 0; t < n_task; ++t) {
+    sum_done += min(done[t].load(memory_order_relaxed), total[t]);
+    sum_total += total[t];
+  }
+  int percent = (sum_total > 0) ? int(100*sum_done/sum_total) : 100;
+  bool complete = (n_finished.load() == n_task);
+  if (markdown && !complete) {
+    return;
+  }
+  if ((percent == last_drawn) && !complete) {
+    return;
+  }
+  
+  // build line
+  const int width = 50;
+  int n_bar = width*percent/100;
+  string line = "  |" + string(n_bar, '=') + string(width - n_bar, ' ') + "|";
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%4d%%", percent);
+  line += buffer;
+  if ((n_task > 1) && (n_task <= 8)) {
+    line += "  (";
+    for (int t = 0; t < n_task; ++t) {
+      int p = (total[t] > 0) ? 100*min(done[t].load(memory_order_relaxed), total[t])/total[t] : 100;
+      snprintf(buffer, sizeof(buffer), "%s%d%%", (t == 0) ? "" : " ", p);
+      line += buffer;
+    }
+    line += ")";
+  }
+  
+  // redraw over the previous line, and finish the line once complete
+#ifdef MARKOVID_STANDALONE
+  ostream &out = cout;
+#else
+  ostream &out = Rcpp::Rcout;
+#endif
+  if (!markdown) {
+    out << "\r";
+  }
+  out << line;
+  if (complete) {
+    out << "\n";
+  }
+  out.flush();
+  last_drawn = complete ? 101 : percent;
+}
@@ -0,0 +1,77 @@
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+//------------------------------------------------
+// class for reporting the progress of any number of tasks (chains) running
+// concurrently. Tasks publish their number of completed iterations through
+// atomic counters, which are cheap to update from any thread and involve no
+// calls to R. The main thread, which is the only thread allowed to call into R,
+// polls the counters at regular intervals, redraws a single progress bar
+// covering all tasks, and checks for user interrupts. Once an interrupt is
+// seen the interrupted flag is raised, and tasks are expected to stop at the
+// end of their current iteration. The main thread polls whenever it updates
+// its own task, and should call wait() once it has run out of tasks
+class Progress {
+  
+public:
+  // PUBLIC OBJECTS
+  
+  // total and completed iterations of each task, and number of finished tasks
+  std::vector<int> total;
+  std::unique_ptr<std::atomic<int>[]> done;
+  std::atomic<int> n_finished;
+  
+  // raised once the user interrupts
+  std::atomic<bool> interrupted;
+  
+  // drawing options. In markdown mode the bar is only drawn once complete
+  bool draw_bar;
+  bool markdown;
+  int last_drawn;
+  
+  // polling is limited to the main thread, and to one poll per interval
+  std::thread::id main_id;
+  std::chrono::steady_clock::time_point last_poll;
+  
+  
+  // PUBLIC FUNCTIONS
+  
+  // constructors. Must be called from the main thread
+  Progress(const std::vector<int> &total, bool draw_bar, bool markdown);
+  
+  // set the completed iterations of a task, which may be called from any
+  // thread, or mark the task as finished
+  void update(int task, int i) {
+    done[task].store(i, std::memory_order_relaxed);
+    if (std::this_thread::get_id() == main_id) {
+      poll();
+    }
+  }
+  void finish(int task);
+  
+  bool is_interrupted() const {
+    return interrupted.load(std::memory_order_relaxed);
+  }
+  
+  // main thread only: redraw and check for interrupts if the polling interval
+  // has passed, or block until every task has finished
+  void poll(bool force = false);
+  void wait();
+  
+private:
+  void draw();
+  
+};
+
+//------------------------------------------------
+// in standalone builds, which cannot poll R for interrupts, SIGINT and SIGTERM
+// are instead treated as user interrupts once this has been called
+#ifdef MARKOVID_STANDALONE
+void catch_interrupt_signals();
+#endif
@@ -0,0 +1,86 @@
+
+#include "RNG.h"
+
+#include <math.h>
+
+using namespace std;
+
+//------------------------------------------------
+// rotate bits left
+static inline uint64_t rotl(const uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+//------------------------------------------------
+// seed the generator. Running splitmix64 from the seed ensures the state is
+// well mixed and never all zero, even for small or similar seeds
+void RNG::seed(uint64_t seed_value) {
+  uint64_t z = seed_value;
+  for (int i = 0; i < 4; ++i) {
+    z += 0x9e3779b97f4a7c15;
+    uint64_t x = z;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    state[i] = x ^ (x >> 31);
+  }
+}
+
+//------------------------------------------------
+// draw raw 64-bit value and advance state
+uint64_t RNG::operator()() {
+  const uint64_t ret = rotl(state[1] * 5, 7) * 9;
+  const uint64_t t = state[1] << 17;
+  state[2] ^= state[0];
+  state[3] ^= state[1];
+  state[1] ^= state[2];
+  state[0] ^= state[3];
+  state[2] ^= t;
+  state[3] = rotl(state[3], 45);
+  return ret;
+}
+
+//------------------------------------------------
+// advance state by the number of draws encoded in the jump polynomial
+void RNG::jump_poly(const uint64_t * poly) {
+  uint64_t s[4] = {0, 0, 0, 0};
+  for (int i = 0; i < 4; ++i) {
+    for (int b = 0; b < 64; ++b) {
+      if (poly[i] & (uint64_t(1) << b)) {
+        for (int j = 0; j < 4; ++j) {
+          s[j] ^= state[j];
+        }
+      }
+      (*this)();
+    }
+  }
+  for (int j = 0; j < 4; ++j) {
+    state[j] = s[j];
+  }
+}
+
+//------------------------------------------------
+// advance state by 2^128 draws
+void RNG::jump() {
+  static const uint64_t poly[4] = {0x180ec6d33cfd0aba, 0xd5a61266f0c9392c,
+                                   0xa9582618e03fc9aa, 0x39abdc4529b1661c};
+  jump_poly(poly);
+}
+
+//------------------------------------------------
+// advance state by 2^192 draws
+void RNG::long_jump() {
+  static const uint64_t poly[4] = {0x76e15d3efefdcbbf, 0xc5004e441c522fb3,
+                                   0x77710069854ee241, 0x39109bb02acbe635};
+  jump_poly(poly);
+}
+
+//------------------------------------------------
+// draw from standard normal distribution using the Box-Muller transform. Draws
+// are computed directly from the uniform stream rather than through
+// std::normal_distribution, whose output differs between standard libraries,
+// so that results are reproducible across platforms
+double RNG::rnorm() {
+  double u1 = 1.0 - runif_0_1();
+  double u2 = runif_0_1();
+  return sqrt(-2.0*log(u1)) * cos(2.0*M_PI*u2);
+}
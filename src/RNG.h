@@ -0,0 +1,54 @@
+
+#pragma once
+
+#include <stdint.h>
+
+//------------------------------------------------
+// class defining a pseudo-random number generator, based on the xoshiro256**
+// algorithm of Blackman and Vigna. Each particle and chain owns its own RNG
+// object, meaning no hidden global state is shared between threads. Streams
+// are separated by jumping ahead: jump() advances the state by 2^128 draws and
+// long_jump() by 2^192 draws, giving non-overlapping streams for each rung
+// within each chain. Satisfies the C++ UniformRandomBitGenerator requirements,
+// and so can be passed to standard library distributions.
+class RNG {
+  
+public:
+  // PUBLIC OBJECTS
+  
+  typedef uint64_t result_type;
+  
+  // generator state. Stored in the open so that it can be saved and restored
+  uint64_t state[4];
+  
+  
+  // PUBLIC FUNCTIONS
+  
+  // constructors
+  RNG() { seed(0); };
+  RNG(uint64_t seed_value) { seed(seed_value); };
+  
+  // seed the generator. The state is filled from the seed using splitmix64
+  void seed(uint64_t seed_value);
+  
+  // draw raw 64-bit value
+  uint64_t operator()();
+  static constexpr uint64_t min() { return 0; }
+  static constexpr uint64_t max() { return UINT64_MAX; }
+  
+  // advance stream
+  void jump();
+  void long_jump();
+  
+  // draw from continuous uniform distribution on interval [0,1)
+  double runif_0_1() {
+    return ((*this)() >> 11) * (1.0 / 9007199254740992.0);  // 2^-53
+  }
+  
+  // draw from standard normal distribution
+  double rnorm();
+  
+private:
+  void jump_poly(const uint64_t * poly);
+  
+};
@@ -5,6 +5,28 @@
 
 using namespace Rcpp;
 
+// aggregate_indlevel_cpp
+Rcpp::List aggregate_indlevel_cpp(Rcpp::List args);
+RcppExport SEXP _markovid_aggregate_indlevel_cpp(SEXP argsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::List >::type args(argsSEXP);
+    rcpp_result_gen = Rcpp::wrap(aggregate_indlevel_cpp(args));
+    return rcpp_result_gen;
+END_RCPP
+}
+// benchmark_kernels_cpp
+Rcpp::List benchmark_kernels_cpp(Rcpp::List args);
+RcppExport SEXP _markovid_benchmark_kernels_cpp(SEXP argsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::List >::type args(argsSEXP);
+    rcpp_result_gen = Rcpp::wrap(benchmark_kernels_cpp(args));
+    return rcpp_result_gen;
+END_RCPP
+}
 // run_mcmc_cpp
 Rcpp::List run_mcmc_cpp(Rcpp::List args);
 RcppExport SEXP _markovid_run_mcmc_cpp(SEXP argsSEXP) {
@@ -16,9 +38,49 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// run_mcmc_batch_cpp
+Rcpp::List run_mcmc_batch_cpp(Rcpp::List args_list, int threads, bool silent);
+RcppExport SEXP _markovid_run_mcmc_batch_cpp(SEXP args_listSEXP, SEXP threadsSEXP, SEXP silentSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::List >::type args_list(args_listSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type silent(silentSEXP);
+    rcpp_result_gen = Rcpp::wrap(run_mcmc_batch_cpp(args_list, threads, silent));
+    return rcpp_result_gen;
+END_RCPP
+}
+// sim_aggregate_cpp
+Rcpp::List sim_aggregate_cpp(Rcpp::List args);
+RcppExport SEXP _markovid_sim_aggregate_cpp(SEXP argsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::List >::type args(argsSEXP);
+    rcpp_result_gen = Rcpp::wrap(sim_aggregate_cpp(args));
+    return rcpp_result_gen;
+END_RCPP
+}
+// spline_quantiles_cpp
+Rcpp::List spline_quantiles_cpp(Rcpp::List args);
+RcppExport SEXP _markovid_spline_quantiles_cpp(SEXP argsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::List >::type args(argsSEXP);
+    rcpp_result_gen = Rcpp::wrap(spline_quantiles_cpp(args));
+    return rcpp_result_gen;
+END_RCPP
+}
 
 static const R_CallMethodDef CallEntries[] = {
+    {"_markovid_aggregate_indlevel_cpp", (DL_FUNC) &_markovid_aggregate_indlevel_cpp, 1},
+    {"_markovid_benchmark_kernels_cpp", (DL_FUNC) &_markovid_benchmark_kernels_cpp, 1},
     {"_markovid_run_mcmc_cpp", (DL_FUNC) &_markovid_run_mcmc_cpp, 1},
+    {"_markovid_run_mcmc_batch_cpp", (DL_FUNC) &_markovid_run_mcmc_batch_cpp, 3},
+    {"_markovid_sim_aggregate_cpp", (DL_FUNC) &_markovid_sim_aggregate_cpp, 1},
+    {"_markovid_spline_quantiles_cpp", (DL_FUNC) &_markovid_spline_quantiles_cpp, 1},
     {NULL, NULL, 0}
 };
 
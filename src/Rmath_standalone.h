@@ -0,0 +1,86 @@
+
+#pragma once
+
+#include <math.h>
+#include <cfloat>
+
+//------------------------------------------------
+// stand-ins for the few functions of R's maths library used by the sampler,
+// for standalone builds that do not link against R. Arguments and return
+// values follow the corresponding functions of the R namespace in Rcpp
+namespace R {
+
+//------------------------------------------------
+// cumulative distribution function of the gamma distribution, from the
+// regularised incomplete gamma function. The lower tail is summed as a power
+// series below shape + 1, and the upper tail is found from its continued
+// fraction above, as in Numerical Recipes
+inline double pgamma(double x, double shape, double scale, bool lower_tail, bool log_p) {
+  double z = x / scale;
+  double lower;
+  if (!(z > 0)) {
+    lower = 0.0;
+  } else {
+    double log_prefactor = shape*log(z) - z - lgamma(shape);
+    if (z < shape + 1) {
+      double term = 1.0 / shape;
+      double sum = term;
+      for (int n = 1; n < 10000; ++n) {
+        term *= z / (shape + n);
+        sum += term;
+        if (fabs(term) < fabs(sum)*DBL_EPSILON) {
+          break;
+        }
+      }
+      lower = sum*exp(log_prefactor);
+    } else {
+      double b = z + 1 - shape;
+      double c = 1.0 / DBL_MIN;
+      double d = 1.0 / b;
+      double h = d;
+      for (int n = 1; n < 10000; ++n) {
+        double a = -n*(n - shape);
+        b += 2;
+        d = a*d + b;
+        if (fabs(d) < DBL_MIN) {
+          d = DBL_MIN;
+        }
+        c = b + a/c;
+        if (fabs(c) < DBL_MIN) {
+          c = DBL_MIN;
+        }
+        d = 1.0 / d;
+        double delta = d*c;
+        h *= delta;
+        if (fabs(delta - 1) < DBL_EPSILON) {
+          break;
+        }
+      }
+      double upper = exp(log_prefactor)*h;
+      if (!lower_tail) {
+        return log_p ? log(upper) : upper;
+      }
+      lower = 1.0 - upper;
+    }
+  }
+  double ret = lower_tail ? lower : 1.0 - lower;
+  return log_p ? log(ret) : ret;
+}
+
+//------------------------------------------------
+// cumulative distribution function of the normal distribution
+inline double pnorm(double x, double mu, double sigma, bool lower_tail, bool log_p) {
+  double z = (x - mu) / sigma;
+  double ret = 0.5*erfc((lower_tail ? -z : z) / sqrt(2.0));
+  return log_p ? log(ret) : ret;
+}
+
+//------------------------------------------------
+// density of the normal distribution
+inline double dnorm(double x, double mu, double sigma, bool give_log) {
+  double z = (x - mu) / sigma;
+  double ret = -0.5*z*z - log(sigma) - 0.5*log(2*M_PI);
+  return give_log ? ret : exp(ret);
+}
+
+}
@@ -0,0 +1,44 @@
+
+#pragma once
+
+#include "Particle.h"
+
+#include <vector>
+
+//------------------------------------------------
+// interface through which the temperature rungs of a single chain can be
+// spread over several processes, each holding a complete copy of the chain but
+// updating only the particles it owns. After every update, share() copies the
+// loglikelihood of every particle from its owner to all processes, which is
+// all that is needed for Metropolis coupling, along with the complete state of
+// a few particles that are needed everywhere (those at stored rungs, and the
+// cold rung). Every process then makes the same coupling moves from the same
+// random number stream, so that beta values and rung order stay identical
+// without further communication, and the chain follows exactly the same path
+// as when run in a single process. Only the root process writes output.
+//
+// Every process must call share() the same number of times, and so processes
+// also agree on interrupts through share(): interrupted is raised on return if
+// any process was interrupted. The same holds for sum(), which combines
+// counts kept separately by each process at the end of each phase.
+class RungGroup {
+  
+public:
+  
+  virtual ~RungGroup() {};
+  
+  // true if particle r is updated by this process
+  virtual bool is_local(int r) const = 0;
+  
+  // true if this process writes the output of the chain
+  virtual bool is_root() const = 0;
+  
+  // share the loglikelihood of every particle, and the loglikelihood,
+  // logprior, theta and acceptance count of each particle in shared
+  virtual void share(std::vector<Particle> &particle_vec, const std::vector<int> &shared,
+                     bool &interrupted) = 0;
+  
+  // replace x by its elementwise sum over all processes
+  virtual void sum(std::vector<int> &x) = 0;
+  
+};
@@ -2,20 +2,17 @@
 #include "System.h"
 #include "misc_v10.h"
 
+#include <stdexcept>
+
 using namespace std;
 
+#ifndef MARKOVID_STANDALONE
+//------------------------------------------------
+// read arguments passed in from R
 void System::load(Rcpp::List args) {
   
   // split argument lists
   Rcpp::List args_params = args["args_params"];
-  Rcpp::List args_functions = args["args_functions"];
-  Rcpp::List args_progress = args["args_progress"];
-  Rcpp::List args_progress_burnin = args_progress["pb_burnin"];
-  
-#define USE_LOOKUP
-#ifdef USE_LOOKUP
-  Rcpp::List args_lookup_density = args["args_lookup_density"];
-#endif
   
   // data list
   Rcpp::List data_list = args_params["data_list"];
@@ -25,27 +22,26 @@ void System::load(Rcpp::List args) {
   
   // age splines
   node_x = rcpp_to_vector_double(data_list["node_x"]);
-  n_node = node_x.size();
   
   // individual-level data
   Rcpp::List indlevel_list = data_list["indlevel"];
   
-  p_AI_numer = rcpp_to_vector_int(indlevel_list["p_AI_numer"]);
-  p_AI_denom = rcpp_to_vector_int(indlevel_list["p_AI_denom"]);
-  p_AD_numer = rcpp_to_vector_int(indlevel_list["p_AD_numer"]);
-  p_AD_denom = rcpp_to_vector_int(indlevel_list["p_AD_denom"]);
-  p_ID_numer = rcpp_to_vector_int(indlevel_list["p_ID_numer"]);
-  p_ID_denom = rcpp_to_vector_int(indlevel_list["p_ID_denom"]);
-  p_SD_numer = rcpp_to_vector_int(indlevel_list["p_SD_numer"]);
-  p_SD_denom = rcpp_to_vector_int(indlevel_list["p_SD_denom"]);
-  m_AI_count = rcpp_to_vector_int(indlevel_list["m_AI_count"]);
-  m_AD_count = rcpp_to_vector_int(indlevel_list["m_AD_count"]);
-  m_AC_count = rcpp_to_vector_int(indlevel_list["m_AC_count"]);
-  m_ID_count = rcpp_to_vector_int(indlevel_list["m_ID_count"]);
-  m_I1S_count = rcpp_to_vector_int(indlevel_list["m_I1S_count"]);
-  m_I2S_count = rcpp_to_vector_int(indlevel_list["m_I2S_count"]);
-  m_SD_count = rcpp_to_vector_int(indlevel_list["m_SD_count"]);
-  m_SC_count = rcpp_to_vector_int(indlevel_list["m_SC_count"]);
+  p_numer = {rcpp_to_vector_int(indlevel_list["p_AI_numer"]),
+             rcpp_to_vector_int(indlevel_list["p_AD_numer"]),
+             rcpp_to_vector_int(indlevel_list["p_ID_numer"]),
+             rcpp_to_vector_int(indlevel_list["p_SD_numer"])};
+  p_denom = {rcpp_to_vector_int(indlevel_list["p_AI_denom"]),
+             rcpp_to_vector_int(indlevel_list["p_AD_denom"]),
+             rcpp_to_vector_int(indlevel_list["p_ID_denom"]),
+             rcpp_to_vector_int(indlevel_list["p_SD_denom"])};
+  vector<vector<int>> m_count = {rcpp_to_vector_int(indlevel_list["m_AI_count"]),
+                                 rcpp_to_vector_int(indlevel_list["m_AD_count"]),
+                                 rcpp_to_vector_int(indlevel_list["m_AC_count"]),
+                                 rcpp_to_vector_int(indlevel_list["m_ID_count"]),
+                                 rcpp_to_vector_int(indlevel_list["m_I1S_count"]),
+                                 rcpp_to_vector_int(indlevel_list["m_I2S_count"]),
+                                 rcpp_to_vector_int(indlevel_list["m_SD_count"]),
+                                 rcpp_to_vector_int(indlevel_list["m_SC_count"])};
   
   // model parameters
   theta_min = rcpp_to_vector_double(args_params["theta_min"]);
@@ -53,26 +49,285 @@ void System::load(Rcpp::List args) {
   theta_init = rcpp_to_vector_double(args_params["theta_init"]);
   trans_type = rcpp_to_vector_int(args_params["trans_type"]);
   skip_param = rcpp_to_vector_bool(args_params["skip_param"]);
-  d = int(theta_min.size());
+  
+  // proposal blocks
+  block_update = rcpp_to_bool(args_params["block_update"]);
+  full_block = rcpp_to_bool(args_params["full_block"]);
+  hmc_update = rcpp_to_bool(args_params["hmc_update"]);
+  hmc_steps = rcpp_to_int(args_params["hmc_steps"]);
+  delayed_accept = rcpp_to_vector_bool(args_params["delayed_accept"]);
+  screen_stride = rcpp_to_int(args_params["screen_stride"]);
   
   // MCMC parameters
   burnin = rcpp_to_int(args_params["burnin"]);
   samples = rcpp_to_int(args_params["samples"]);
+  converge_test = rcpp_to_bool(args_params["converge_test"]);
+  converge_interval = rcpp_to_int(args_params["converge_interval"]);
+  converge_alpha = rcpp_to_double(args_params["converge_alpha"]);
   beta_vec = rcpp_to_vector_double(args_params["beta_vec"]);
-  rungs = beta_vec.size();
-  chain = rcpp_to_int(args_params["chain"]);
+  adapt_beta = rcpp_to_bool(args_params["adapt_beta"]);
+  
+  // output storage
+  thin = rcpp_to_int(args_params["thin"]);
+  store_rungs = rcpp_to_vector_int(args_params["store_rungs"]);
+  chains = rcpp_to_int(args_params["chains"]);
+  threads = rcpp_to_int(args_params["threads"]);
+  parallel_rungs = rcpp_to_bool(args_params["parallel_rungs"]);
+  seed = rcpp_to_int(args_params["seed"]);
+  
+  // checkpointing
+  checkpoint_file = rcpp_to_string(args_params["checkpoint_file"]);
+  checkpoint_interval = rcpp_to_int(args_params["checkpoint_interval"]);
+  resume = rcpp_to_bool(args_params["resume"]);
+  
+  // streamed output
+  output_file = rcpp_to_string(args_params["output_file"]);
+  output_precision = rcpp_to_int(args_params["output_precision"]);
   
   // misc parameters
   pb_markdown = rcpp_to_bool(args_params["pb_markdown"]);
   silent = rcpp_to_bool(args_params["silent"]);
   
-  // populate lookup tables
-#ifdef USE_LOOKUP
-  int n_m = args_lookup_density.size();
-  gamma_density_lookup = std::vector<std::vector<std::vector<double>>>(n_m);
-  for (int i = 0; i < n_m; ++i) {
-    gamma_density_lookup[i] = rcpp_to_matrix_double(args_lookup_density[i]);
-  }
+  // lookup table specification
+  Rcpp::List lookup_list = args_params["lookup"];
+  LookupSpec lookup_spec;
+  lookup_spec.m_max = rcpp_to_double(lookup_list["m_max"]);
+  lookup_spec.m_step = rcpp_to_double(lookup_list["m_step"]);
+  lookup_spec.n_s = rcpp_to_int(lookup_list["n_shape"]);
+  lookup_spec.x_max = rcpp_to_int(lookup_list["x_max"]);
+  lookup_spec.interp_m = rcpp_to_bool(lookup_list["interp_m"]);
+  lookup_spec.interp_s = rcpp_to_bool(lookup_list["interp_s"]);
+  
+  setup(m_count, lookup_spec);
+}
 #endif
+
+//------------------------------------------------
+// derive everything else from the inputs, once all inputs have been read.
+// store_rungs is converted here from one-based to zero-based positions
+void System::setup(const vector<vector<int>> &m_count, const LookupSpec &lookup_spec) {
+  
+  // node_x and ages are fixed, so the spline is a fixed linear map from node
+  // values to values at each age. Precompute this map once
+  n_node = node_x.size();
+  n_age = max_indlevel_age + 1;
+  vector<double> age_seq(n_age);
+  for (int i = 0; i < n_age; ++i) {
+    age_seq[i] = i;
+  }
+  cubic_spline_basis(node_x, age_seq, spline_basis);
+  spline_kernel = get_spline_kernel(n_node);
+  
+  // individual-level data
+  n_trans = int(p_numer.size());
+  n_dur = int(m_count.size());
+  precompute_binomial();
+  precompute_screen();
+  
+  // map each parameter to the likelihood block it feeds into. theta contains
+  // n_node spline nodes per transition, followed by one mean and one shape
+  // parameter per duration
+  d = int(theta_min.size());
+  n_block = n_trans + n_dur;
+  param_block = vector<int>(d);
+  for (int i = 0; i < d; ++i) {
+    if (i < n_trans*n_node) {
+      param_block[i] = i / n_node;
+    } else {
+      param_block[i] = n_trans + (i - n_trans*n_node) % n_dur;
+    }
+  }
+  
+  // MCMC parameters
+  converge_thin = max(1, burnin / 10000);
+  rungs = beta_vec.size();
+  if (int(delayed_accept.size()) != rungs) {
+    throw runtime_error("delayed_accept must have one value per rung");
+  }
+  
+  // output storage
+  for (unsigned int j = 0; j < store_rungs.size(); ++j) {
+    store_rungs[j]--;
+  }
+  n_store_burnin = (burnin - 1) / thin + 1;
+  n_store_sampling = (samples - 1) / thin + 1;
+  n_store_iter = n_store_burnin + n_store_sampling;
+  n_store_row = n_store_iter * int(store_rungs.size());
+  chain = 1;
+  
+  // streamed output
+  output_block_rows = output_file.empty() ? n_store_iter : min(n_store_iter, 1000);
+  
+  // split threads between chains and rungs. Threads go to chains first, and
+  // if parallel_rungs is true then any remaining threads are shared between the
+  // rungs of each chain
+  chain_threads = min(threads, chains);
+  rung_threads = 1;
+  if (parallel_rungs) {
+    rung_threads = min(max(threads / chain_threads, 1), rungs);
+  }
+  
+  // get lookup table matching the grid specification (built once per process)
+  lookup_ptr = &get_lookup(lookup_spec);
+  
+  // duration histograms are mostly zero, so store nonzero days only
+  compress_counts(m_count);
+  
+  // transformations and free parameters, then proposal blocks over them
+  define_layout();
+  define_update_blocks();
+  
+}
+
+//------------------------------------------------
+// resolve the transformation of each parameter from its type, and list the
+// parameters that are updated. Must be called again if trans_type, theta_min,
+// theta_max or skip_param change
+void System::define_layout() {
+  transform.clear();
+  free_param.clear();
+  for (int i = 0; i < d; ++i) {
+    switch(trans_type[i]) {
+    case 0:
+      transform.push_back(ParamTransform::make<0>(theta_min[i], theta_max[i]));
+      break;
+    case 1:
+      transform.push_back(ParamTransform::make<1>(theta_min[i], theta_max[i]));
+      break;
+    case 2:
+      transform.push_back(ParamTransform::make<2>(theta_min[i], theta_max[i]));
+      break;
+    case 3:
+      transform.push_back(ParamTransform::make<3>(theta_min[i], theta_max[i]));
+      break;
+    default:
+      throw runtime_error("trans_type invalid");
+    }
+    if (!skip_param[i]) {
+      free_param.push_back(i);
+    }
+  }
+}
+
+//------------------------------------------------
+// compress dense duration histograms into sparse (day, count) pairs. Must be
+// called after the lookup table is set
+void System::compress_counts(const vector<vector<int>> &m_count) {
+  m_day = vector<vector<int>>(n_dur);
+  m_day_count = vector<vector<int>>(n_dur);
+  m_n_lookup = vector<int>(n_dur);
+  for (int j = 0; j < n_dur; ++j) {
+    for (int k = 0; k < int(m_count[j].size()); ++k) {
+      if (m_count[j][k] > 0) {
+        m_day[j].push_back(k);
+        m_day_count[j].push_back(m_count[j][k]);
+        if (k < lookup_ptr->n_x) {
+          m_n_lookup[j]++;
+        }
+      }
+    }
+  }
+}
+
+//------------------------------------------------
+// flatten binomial data into contiguous arrays over all transitions, and
+// precompute log binomial coefficients so they are not recalculated inside the
+// likelihood
+void System::precompute_binomial() {
+  trans_numer = vector<double>(n_trans*n_age);
+  trans_denom = vector<double>(n_trans*n_age);
+  trans_lchoose = vector<double>(n_trans*n_age);
+  for (int t = 0; t < n_trans; ++t) {
+    for (int i = 0; i < n_age; ++i) {
+      double k = p_numer[t][i];
+      double n = p_denom[t][i];
+      trans_numer[t*n_age + i] = k;
+      trans_denom[t*n_age + i] = n;
+      trans_lchoose[t*n_age + i] = lgamma(n + 1.0) - lgamma(k + 1.0) - lgamma(n - k + 1.0);
+    }
+  }
+}
+
+//------------------------------------------------
+// pool binomial data over bins of screen_stride consecutive ages, as used by
+// the surrogate loglikelihood of delayed acceptance. Must be called after
+// precompute_binomial()
+void System::precompute_screen() {
+  n_screen = vector<int>(n_trans);
+  screen_basis = vector<vector<double>>(n_trans);
+  screen_numer = vector<vector<double>>(n_trans);
+  screen_denom = vector<vector<double>>(n_trans);
+  screen_cost = 0.0;
+  for (int t = 0; t < n_trans; ++t) {
+    vector<double> bin_age;
+    for (int a = 0; a < n_age; a += screen_stride) {
+      double k = 0.0;
+      double n = 0.0;
+      double n_age_sum = 0.0;
+      for (int i = a; i < min(a + screen_stride, n_age); ++i) {
+        k += trans_numer[t*n_age + i];
+        n += trans_denom[t*n_age + i];
+        n_age_sum += trans_denom[t*n_age + i]*i;
+      }
+      if (n > 0) {
+        bin_age.push_back(n_age_sum / n);
+        screen_numer[t].push_back(k);
+        screen_denom[t].push_back(n);
+      }
+    }
+    n_screen[t] = int(bin_age.size());
+    cubic_spline_basis(node_x, bin_age, screen_basis[t]);
+    screen_cost += double(n_screen[t]) / (n_trans*n_age);
+  }
+}
+
+//------------------------------------------------
+// group free parameters into blocks that are proposed jointly. Blocks with no
+// free parameters are dropped. Must be called after the lookup table and the
+// free parameters are set
+void System::define_update_blocks() {
+  update_blocks.clear();
+  update_block_loglike.clear();
+  update_block_hmc.clear();
+  int m_offset = n_trans*n_node;
+  int s_offset = m_offset + n_dur;
+  
+  // one block per likelihood block, that is one per transition spline and
+  // one per duration (m, s) pair. free_param is in increasing order, so
+  // parameters within each block are too
+  vector<vector<int>> block_param(n_block);
+  for (int i : free_param) {
+    block_param[param_block[i]].push_back(i);
+  }
+  for (int b = 0; b < n_block; ++b) {
+    if (!block_param[b].empty()) {
+      update_blocks.push_back(block_param[b]);
+      update_block_loglike.push_back(b);
+    }
+  }
+  
+  // optional block over all free parameters
+  if (full_block && !free_param.empty()) {
+    update_blocks.push_back(free_param);
+    update_block_loglike.push_back(-1);
+  }
+  
+  // Hamiltonian Monte Carlo is used only for blocks over which the
+  // loglikelihood is differentiable. The lookup table makes the loglikelihood
+  // a step function of the mean or shape of a duration unless it interpolates
+  // in that dimension, in which case gradients carry no information
+  for (const vector<int> &block : update_blocks) {
+    bool smooth = true;
+    for (int i : block) {
+      if (i >= s_offset) {
+        smooth = smooth && lookup_ptr->spec.interp_s;
+      } else if (i >= m_offset) {
+        smooth = smooth && lookup_ptr->spec.interp_m;
+      }
+    }
+    update_block_hmc.push_back(smooth);
+  }
   
+  // number of proposals per iteration
+  n_update = (block_update || hmc_update) ? int(update_blocks.size()) : int(free_param.size());
 }
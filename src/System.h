@@ -1,9 +1,15 @@
 
 #pragma once
 
+#include "Lookup.h"
+#include "Layout.h"
+
+#ifndef MARKOVID_STANDALONE
 #include <Rcpp.h>
+#endif
 
 #include <vector>
+#include <string>
 
 //------------------------------------------------
 // class holding all data, parameters and functions
@@ -15,27 +21,37 @@ public:
   // misc data
   int max_indlevel_age;
   
-  // age splines
+  // age splines. spline_basis maps node values to spline values at each
+  // integer age from 0 to max_indlevel_age, stored in column-major order
+  // (n_age rows, n_node columns). spline_kernel applies this map, specialised
+  // for the value of n_node where possible
   std::vector<double> node_x;
   int n_node;
+  int n_age;
+  std::vector<double> spline_basis;
+  SplineKernel spline_kernel;
+  
+  // individual-level data. Transitions are stored in the order AI, AD, ID, SD
+  // and durations in the order AI, AD, AC, ID, I1S, I2S, SD, SC, matching the
+  // order of parameters in theta
+  int n_trans;
+  int n_dur;
+  std::vector<std::vector<int>> p_numer;
+  std::vector<std::vector<int>> p_denom;
+  
+  // binomial data in structure-of-arrays form, with the n_age values of each
+  // transition stored contiguously (element t*n_age + i). trans_lchoose holds
+  // the log binomial coefficients, which are fixed by the data
+  std::vector<double> trans_numer;
+  std::vector<double> trans_denom;
+  std::vector<double> trans_lchoose;
   
-  // individual-level data
-  std::vector<int> p_AI_numer;
-  std::vector<int> p_AI_denom;
-  std::vector<int> p_AD_numer;
-  std::vector<int> p_AD_denom;
-  std::vector<int> p_ID_numer;
-  std::vector<int> p_ID_denom;
-  std::vector<int> p_SD_numer;
-  std::vector<int> p_SD_denom;
-  std::vector<int> m_AI_count;
-  std::vector<int> m_AD_count;
-  std::vector<int> m_AC_count;
-  std::vector<int> m_ID_count;
-  std::vector<int> m_I1S_count;
-  std::vector<int> m_I2S_count;
-  std::vector<int> m_SD_count;
-  std::vector<int> m_SC_count;
+  // duration histograms compressed to (day, count) pairs over nonzero days
+  // only, in increasing order of day. The first m_n_lookup[j] pairs of each
+  // duration lie inside the range of the lookup table
+  std::vector<std::vector<int>> m_day;
+  std::vector<std::vector<int>> m_day_count;
+  std::vector<int> m_n_lookup;
   
   // model parameters
   std::vector<double> theta_min;
@@ -45,19 +61,113 @@ public:
   std::vector<bool> skip_param;
   int d;
   
+  // model layout resolved at load time. transform holds the transformation of
+  // each parameter, and free_param lists the parameters that are not fixed, in
+  // increasing order
+  std::vector<ParamTransform> transform;
+  std::vector<int> free_param;
+  
+  // likelihood block that each parameter feeds into. Blocks 0 to (n_trans-1)
+  // are transitions, and the remaining n_dur blocks are durations
+  std::vector<int> param_block;
+  int n_block;
+  
+  // proposals. If block_update is true then each iteration makes one joint
+  // Metropolis-Hastings proposal per update block, rather than one univariate
+  // proposal per parameter. update_blocks lists the free parameters of each
+  // block: one block per transition spline, one per duration (m, s) pair, and
+  // if full_block is true a final block over all free parameters.
+  // update_block_loglike gives the likelihood block affected by each update
+  // block, or -1 if all likelihood blocks are affected. If hmc_update is true
+  // then each iteration instead runs one Hamiltonian Monte Carlo trajectory
+  // of at most hmc_steps leapfrog steps over each block flagged in
+  // update_block_hmc, and makes a joint proposal over every other block.
+  // n_update is the number of proposals made per iteration
+  bool block_update;
+  bool full_block;
+  bool hmc_update;
+  int hmc_steps;
+  std::vector<bool> update_block_hmc;
+  std::vector<std::vector<int>> update_blocks;
+  std::vector<int> update_block_loglike;
+  int n_update;
+  
+  // delayed acceptance. At each ladder position (from hottest to coldest)
+  // where delayed_accept is true, Metropolis-Hastings proposals to spline
+  // nodes are first screened against a cheap surrogate of the transition
+  // loglikelihood, and only those that pass go on to the exact
+  // loglikelihood. The surrogate pools the binomial data of each transition
+  // over bins of screen_stride consecutive ages, and evaluates the spline
+  // once per bin, at the mean age of the bin weighted by denominators. Bins
+  // without data are dropped. screen_basis maps node values to spline values
+  // at the n_screen[t] bins of transition t, in column-major order, and
+  // screen_numer and screen_denom hold the pooled data. screen_cost is the
+  // number of bins relative to the number of ages, averaged over transitions
+  std::vector<bool> delayed_accept;
+  int screen_stride;
+  std::vector<int> n_screen;
+  std::vector<std::vector<double>> screen_basis;
+  std::vector<std::vector<double>> screen_numer;
+  std::vector<std::vector<double>> screen_denom;
+  double screen_cost;
+  
   // MCMC parameters
   int burnin;
   int samples;
+  
+  // early stopping of burn-in. If converge_test is true then every
+  // converge_interval iterations the cold rung is tested for convergence, and
+  // burn-in ends as soon as the test passes, with burnin acting as the maximum
+  // length. converge_alpha is the significance level of the Geweke test, and
+  // only every converge_thin-th iteration is kept for testing
+  bool converge_test;
+  int converge_interval;
+  double converge_alpha;
+  int converge_thin;
+  
+  // output storage. store_rungs gives the (zero-based) ladder positions that
+  // are stored, and every thin-th iteration of each phase is stored
+  int thin;
+  std::vector<int> store_rungs;
+  int n_store_burnin;
+  int n_store_sampling;
+  int n_store_iter;
+  int n_store_row;
   std::vector<double> beta_vec;
   int rungs;
+  bool adapt_beta;
+  int chains;
   int chain;
+  int threads;
+  bool parallel_rungs;
+  int chain_threads;
+  int rung_threads;
+  unsigned int seed;
+  
+  // checkpointing. If checkpoint_file is non-empty then the complete state of
+  // each chain is written to its own file, named from checkpoint_file and the
+  // chain number, every checkpoint_interval iterations and at the end of each
+  // phase. If resume is true then chains continue from these files where they
+  // exist
+  std::string checkpoint_file;
+  int checkpoint_interval;
+  bool resume;
+  
+  // streamed output. If output_file is non-empty then stored iterations are
+  // written to one binary file per chain, named from output_file and the chain
+  // number, rather than held in memory. Values are written with
+  // output_precision bytes (4 or 8), and chains hold at most output_block_rows
+  // stored iterations per stored rung in memory before writing them out
+  std::string output_file;
+  int output_precision;
+  int output_block_rows;
   
   // misc parameters
   bool pb_markdown;
   bool silent;
   
-  // lookup tables
-  std::vector<std::vector<std::vector<double>>> gamma_density_lookup;
+  // lookup table of delay log-densities, shared between all chains
+  const Lookup * lookup_ptr;
   
   
   // PUBLIC FUNCTIONS
@@ -65,7 +175,17 @@ public:
   // constructors
   System() {};
   
-  // public methods
+  // public methods. load() reads arguments passed in from R, and then calls
+  // setup(), which derives everything else from the inputs once all of them
+  // have been read. Standalone builds read the same inputs from file
+#ifndef MARKOVID_STANDALONE
   void load(Rcpp::List args);
+#endif
+  void setup(const std::vector<std::vector<int>> &m_count, const LookupSpec &lookup_spec);
+  void compress_counts(const std::vector<std::vector<int>> &m_count);
+  void precompute_binomial();
+  void precompute_screen();
+  void define_layout();
+  void define_update_blocks();
   
 };
@@ -0,0 +1,180 @@
+
+#include "aggregate.h"
+#include "misc_v10.h"
+
+#include <math.h>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+//------------------------------------------------
+// add a duration in days to a histogram of t_max bins, where bin x holds
+// durations of x - 1 days. Mirrors R's tabulate(), which truncates to integer
+// and drops anything outside the bins, including missing values
+inline void tabulate_delay(double days, int t_max, int *hist) {
+  double x = days + 1;
+  if ((x >= 1) && (x < t_max + 1)) {
+    hist[int(x) - 1]++;
+  }
+}
+
+//------------------------------------------------
+// positions in age_vec of each integer age from 0 to max(age_vec), allowing for
+// repeated ages
+vector<vector<int>> get_age_pos(const vector<int> &age_vec) {
+  int age_max = *max_element(age_vec.begin(), age_vec.end());
+  vector<vector<int>> ret(age_max + 1);
+  for (int i = 0; i < int(age_vec.size()); ++i) {
+    ret[age_vec[i]].push_back(i);
+  }
+  return ret;
+}
+
+//------------------------------------------------
+// add a single row of individual-level data to the transition counts and
+// duration histograms
+void count_indlevel_row(double age, int icu, int stepdown, int outcome,
+                        double date_admission, double date_icu,
+                        double date_stepdown, double date_final_outcome,
+                        const vector<vector<int>> &age_pos, int n_age, int t_max,
+                        int *trans, int *hist) {
+  
+  bool is_death = (outcome == 1);
+  bool has_outcome = is_death || (outcome == 2);
+  
+  // transitions, counted once for every matching position in age_vec. Missing
+  // and non-integer ages match nothing
+  int age_max = int(age_pos.size()) - 1;
+  if ((age >= 0) && (age <= age_max) && (age == floor(age))) {
+    for (int i : age_pos[int(age)]) {
+      if (icu != NA_INTEGER) {
+        trans[AI_DENOM*n_age + i]++;
+        trans[AI_NUMER*n_age + i] += (icu == 1);
+      }
+      if ((icu == 0) && has_outcome) {
+        trans[AD_DENOM*n_age + i]++;
+        trans[AD_NUMER*n_age + i] += is_death;
+      }
+      if ((icu == 1) && (stepdown != NA_INTEGER)) {
+        trans[ID_DENOM*n_age + i]++;
+        trans[ID_NUMER*n_age + i] += (stepdown == 0);
+      }
+      if ((stepdown == 1) && has_outcome) {
+        trans[SD_DENOM*n_age + i]++;
+        trans[SD_NUMER*n_age + i] += is_death;
+      }
+    }
+  }
+  
+  // durations, over all ages
+  if (icu == 0) {
+    if (has_outcome) {
+      tabulate_delay(date_final_outcome - date_admission, t_max, hist + (is_death ? M_AD : M_AC)*t_max);
+    }
+  } else if (icu == 1) {
+    tabulate_delay(date_icu - date_admission, t_max, hist + M_AI*t_max);
+    if (is_death) {
+      tabulate_delay(date_final_outcome - date_icu, t_max, hist + M_ID*t_max);
+    }
+    if ((stepdown == 1) && has_outcome) {
+      tabulate_delay(date_stepdown - date_icu, t_max, hist + (is_death ? M_I1S : M_I2S)*t_max);
+      tabulate_delay(date_final_outcome - date_stepdown, t_max, hist + (is_death ? M_SD : M_SC)*t_max);
+    }
+  }
+  
+}
+
+//------------------------------------------------
+// aggregate individual-level data in a single pass over rows
+void aggregate_indlevel_rows(int n, const double *age, const int *icu,
+                             const int *stepdown, const int *outcome,
+                             const double *date_admission, const double *date_icu,
+                             const double *date_stepdown, const double *date_final_outcome,
+                             const vector<int> &age_vec, int t_max, int threads,
+                             vector<int> &count) {
+  
+  vector<vector<int>> age_pos = get_age_pos(age_vec);
+  int n_age = int(age_vec.size());
+  int n_count = N_TRANS_COUNT*n_age + N_DUR_COUNT*t_max;
+  count = vector<int>(n_count);
+  
+#ifdef _OPENMP
+#pragma omp parallel num_threads(threads)
+#endif
+  {
+    vector<int> local(n_count);
+    int *trans = local.data();
+    int *hist = local.data() + N_TRANS_COUNT*n_age;
+    
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (int r = 0; r < n; ++r) {
+      count_indlevel_row(age[r], icu[r], stepdown[r], outcome[r], date_admission[r],
+                         date_icu[r], date_stepdown[r], date_final_outcome[r],
+                         age_pos, n_age, t_max, trans, hist);
+    }
+    
+    // merge counts of each thread
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    for (int k = 0; k < n_count; ++k) {
+      count[k] += local[k];
+    }
+  }
+  
+}
+
+//------------------------------------------------
+// split counts into named vectors of transition numerators and denominators by
+// age and duration histograms
+Rcpp::List get_indlevel_list(const vector<int> &count, int n_age, int t_max) {
+  vector<string> trans_names = {"p_AI_numer", "p_AI_denom", "p_AD_numer", "p_AD_denom",
+                                "p_ID_numer", "p_ID_denom", "p_SD_numer", "p_SD_denom"};
+  vector<string> dur_names = {"m_AI_count", "m_AD_count", "m_AC_count", "m_ID_count",
+                              "m_I1S_count", "m_I2S_count", "m_SD_count", "m_SC_count"};
+  Rcpp::List ret;
+  for (int k = 0; k < N_TRANS_COUNT; ++k) {
+    auto first = count.begin() + k*n_age;
+    ret[trans_names[k]] = Rcpp::IntegerVector(first, first + n_age);
+  }
+  for (int k = 0; k < N_DUR_COUNT; ++k) {
+    auto first = count.begin() + N_TRANS_COUNT*n_age + k*t_max;
+    ret[dur_names[k]] = Rcpp::IntegerVector(first, first + t_max);
+  }
+  return ret;
+}
+
+//------------------------------------------------
+// aggregate individual-level data into transition counts by age and duration
+// histograms. Columns arrive already coded as described for
+// aggregate_indlevel_rows()
+Rcpp::List aggregate_indlevel_cpp(Rcpp::List args) {
+  
+  // extract columns
+  Rcpp::NumericVector age = args["age"];
+  Rcpp::IntegerVector icu = args["icu"];
+  Rcpp::IntegerVector stepdown = args["stepdown"];
+  Rcpp::IntegerVector outcome = args["final_outcome"];
+  Rcpp::NumericVector date_admission = args["date_admission"];
+  Rcpp::NumericVector date_icu = args["date_icu"];
+  Rcpp::NumericVector date_stepdown = args["date_stepdown"];
+  Rcpp::NumericVector date_final_outcome = args["date_final_outcome"];
+  vector<int> age_vec = rcpp_to_vector_int(args["age_vec"]);
+  int t_max = rcpp_to_int(args["t_max"]);
+  int threads = rcpp_to_int(args["threads"]);
+  
+  // count in a single pass
+  vector<int> count;
+  aggregate_indlevel_rows(age.size(), age.begin(), icu.begin(), stepdown.begin(),
+                          outcome.begin(), date_admission.begin(), date_icu.begin(),
+                          date_stepdown.begin(), date_final_outcome.begin(),
+                          age_vec, t_max, threads, count);
+  
+  return get_indlevel_list(count, int(age_vec.size()), t_max);
+}
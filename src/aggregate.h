@@ -0,0 +1,56 @@
+
+#pragma once
+
+#include <Rcpp.h>
+
+#include <vector>
+
+// offsets of the transition counts, each of n_age values
+enum {AI_NUMER, AI_DENOM, AD_NUMER, AD_DENOM, ID_NUMER, ID_DENOM, SD_NUMER, SD_DENOM, N_TRANS_COUNT};
+
+// offsets of the duration histograms, each of t_max values
+enum {M_AI, M_AD, M_AC, M_ID, M_I1S, M_I2S, M_SD, M_SC, N_DUR_COUNT};
+
+//------------------------------------------------
+// positions in age_vec of each integer age from 0 to max(age_vec), allowing for
+// repeated ages
+std::vector<std::vector<int>> get_age_pos(const std::vector<int> &age_vec);
+
+//------------------------------------------------
+// add a single row of individual-level data to the transition counts and
+// duration histograms, coded as described for aggregate_indlevel_rows(). trans
+// points to the first transition count and hist to the first histogram, and
+// age_pos is as returned by get_age_pos()
+void count_indlevel_row(double age, int icu, int stepdown, int outcome,
+                        double date_admission, double date_icu,
+                        double date_stepdown, double date_final_outcome,
+                        const std::vector<std::vector<int>> &age_pos, int n_age, int t_max,
+                        int *trans, int *hist);
+
+//------------------------------------------------
+// aggregate individual-level data in a single pass over rows. Flags (icu,
+// stepdown) are coded 0 = FALSE, 1 = TRUE and NA_INTEGER = missing, and
+// outcome is coded 1 = death, 2 = discharge and anything else = missing or
+// other. Dates are in days, with NaN for missing values. On return count holds
+// 8 vectors of n_age values (numerator and denominator of the AI, AD, ID and SD
+// transitions by age), followed by 8 histograms of t_max bins (durations AI,
+// AD, AC, ID, I1S, I2S, SD and SC), matching the output of
+// aggregate_indlevel(). Rows are split into chunks over threads, each of which
+// counts into its own copy of the output before the copies are merged
+void aggregate_indlevel_rows(int n, const double *age, const int *icu,
+                             const int *stepdown, const int *outcome,
+                             const double *date_admission, const double *date_icu,
+                             const double *date_stepdown, const double *date_final_outcome,
+                             const std::vector<int> &age_vec, int t_max, int threads,
+                             std::vector<int> &count);
+
+//------------------------------------------------
+// split counts, laid out as by aggregate_indlevel_rows(), into named vectors
+// matching the output of aggregate_indlevel()
+Rcpp::List get_indlevel_list(const std::vector<int> &count, int n_age, int t_max);
+
+//------------------------------------------------
+// aggregate individual-level data into transition counts by age and duration
+// histograms
+// [[Rcpp::export]]
+Rcpp::List aggregate_indlevel_cpp(Rcpp::List args);
@@ -0,0 +1,122 @@
+
+#include "benchmark.h"
+#include "misc_v10.h"
+#include "probability_v10.h"
+
+#include <chrono>
+
+using namespace std;
+
+//------------------------------------------------
+// run kernel f(i) for i in 0 to (reps-1) and return the elapsed time in seconds
+template<class FUNC>
+double time_kernel(int reps, FUNC f) {
+  chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+  for (int i = 0; i < reps; ++i) {
+    f(i);
+  }
+  chrono::duration<double> time_span = chrono::steady_clock::now() - t0;
+  return time_span.count();
+}
+
+//------------------------------------------------
+// time the main likelihood, prior, spline and lookup kernels of a single
+// particle, repeating each kernel a fixed number of times
+Rcpp::List benchmark_kernels_cpp(Rcpp::List args) {
+  
+  // create sytem object and load args
+  System s;
+  s.load(args);
+  Rcpp::List args_benchmark = args["args_benchmark"];
+  int reps = rcpp_to_int(args_benchmark["reps"]);
+  int sweeps = rcpp_to_int(args_benchmark["sweeps"]);
+  
+  // initialise a single particle at the initial values
+  Particle p;
+  p.init(s, RNG(s.seed));
+  
+  // parameters that are free to move, split into spline nodes and durations
+  vector<int> spline_params, duration_params;
+  for (int i : s.free_param) {
+    if (s.param_block[i] < s.n_trans) {
+      spline_params.push_back(i);
+    } else {
+      duration_params.push_back(i);
+    }
+  }
+  
+  // objects for storing results
+  vector<string> kernel;
+  vector<int> calls;
+  vector<double> seconds;
+  
+  // results are accumulated into sink so that kernels cannot be optimised away
+  volatile double sink = 0.0;
+  
+  // full loglikelihood
+  kernel.push_back("loglike_full");
+  calls.push_back(reps);
+  seconds.push_back(time_kernel(reps, [&](int) {
+    sink = sink + p.get_loglike(p.theta, -1);
+  }));
+  
+  // incremental loglikelihood after moving a single spline node
+  if (spline_params.size() > 0) {
+    kernel.push_back("loglike_transition");
+    calls.push_back(reps);
+    seconds.push_back(time_kernel(reps, [&](int i) {
+      sink = sink + p.get_loglike(p.theta, spline_params[i % spline_params.size()]);
+    }));
+  }
+  
+  // incremental loglikelihood after moving a single duration parameter
+  if (duration_params.size() > 0) {
+    kernel.push_back("loglike_duration");
+    calls.push_back(reps);
+    seconds.push_back(time_kernel(reps, [&](int i) {
+      sink = sink + p.get_loglike(p.theta, duration_params[i % duration_params.size()]);
+    }));
+  }
+  
+  // logprior
+  kernel.push_back("logprior");
+  calls.push_back(reps);
+  seconds.push_back(time_kernel(reps, [&](int) {
+    sink = sink + p.get_logprior(p.theta, -1);
+  }));
+  
+  // cubic spline through the nodes of the first transition, evaluated over all
+  // ages
+  vector<double> age_seq(s.n_age);
+  for (int i = 0; i < s.n_age; ++i) {
+    age_seq[i] = i;
+  }
+  vector<double> node_y(p.theta.begin(), p.theta.begin() + s.n_node);
+  vector<double> spline_y(s.n_age);
+  kernel.push_back("cubic_spline");
+  calls.push_back(reps);
+  seconds.push_back(time_kernel(reps, [&](int) {
+    cubic_spline(s.node_x, node_y, age_seq, spline_y);
+    sink = sink + spline_y[0];
+  }));
+  
+  // single delay log-density, cycling over days and a range of durations
+  int n_density = 100*reps;
+  kernel.push_back("delay_density");
+  calls.push_back(n_density);
+  seconds.push_back(time_kernel(n_density, [&](int i) {
+    sink = sink + p.get_delay_logdensity(i % 101, 1.0 + (i % 1700)*0.01, 1.0 + (i % 9));
+  }));
+  
+  // full sweep of univariate Metropolis-Hastings updates over all parameters
+  kernel.push_back("update_sweep");
+  calls.push_back(sweeps);
+  seconds.push_back(time_kernel(sweeps, [&](int) {
+    p.update(1.0);
+  }));
+  
+  // return as list
+  return Rcpp::List::create(Rcpp::Named("kernel") = kernel,
+                            Rcpp::Named("calls") = calls,
+                            Rcpp::Named("seconds") = seconds);
+}
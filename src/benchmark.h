@@ -0,0 +1,13 @@
+
+#pragma once
+
+#include "System.h"
+#include "Particle.h"
+
+#include <Rcpp.h>
+
+//------------------------------------------------
+// time the main likelihood, prior, spline and lookup kernels of a single
+// particle, repeating each kernel a fixed number of times
+// [[Rcpp::export]]
+Rcpp::List benchmark_kernels_cpp(Rcpp::List args);
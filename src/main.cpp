@@ -5,249 +5,440 @@
 #include "System.h"
 
 #include <chrono>
+#include <memory>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace std;
 
 //------------------------------------------------
-// run MCMC
-Rcpp::List run_mcmc_cpp(Rcpp::List args) {
-  
-  // start timer
-  chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+// load arguments and allocate output. Output columns are allocated over all
+// chains, with each chain writing directly into its own block of rows, so that
+// columns are returned to R without a further copy. Memory is allocated here on
+// the main thread as R objects cannot be created from worker threads
+McmcRun::McmcRun(Rcpp::List args) {
   
   // create sytem object and load args
-  System s;
   s.load(args);
+  int chains = s.chains;
   
-  // extract R utility functions that will be called from within MCMC
-  Rcpp::List args_functions = args["args_functions"];
-  Rcpp::Function test_convergence = args_functions["test_convergence"];
-  Rcpp::Function update_progress = args_functions["update_progress"];
-  
-  // extract progress bar objects
-  Rcpp::List args_progress = args["args_progress"];
+  // each chain gets its own copy of the system object
+  s_vec = vector<System>(chains, s);
+  for (int c = 0; c < chains; ++c) {
+    s_vec[c].chain = c + 1;
+  }
   
-  // local copies of some parameters for convenience
-  int d = s.d;
-  vector<double> beta_vec = s.beta_vec;
-  int rungs = s.rungs;
+  // output columns, which are empty when streaming
+  streaming = !s.output_file.empty();
+  int n_row = streaming ? 0 : chains*s.n_store_row;
+  loglike_col = Rcpp::NumericVector(n_row);
+  logprior_col = Rcpp::NumericVector(n_row);
+  theta_col = vector<Rcpp::NumericVector>(s.d);
+  for (int i = 0; i < s.d; ++i) {
+    theta_col[i] = Rcpp::NumericVector(n_row);
+  }
+  loglike_ptr = vector<double *>(chains);
+  logprior_ptr = vector<double *>(chains);
+  theta_ptr = vector<vector<double *>>(chains, vector<double *>(s.d));
+  for (int c = 0; c < chains; ++c) {
+    loglike_ptr[c] = loglike_col.begin() + c*s.n_store_row;
+    logprior_ptr[c] = logprior_col.begin() + c*s.n_store_row;
+    for (int i = 0; i < s.d; ++i) {
+      theta_ptr[c][i] = theta_col[i].begin() + c*s.n_store_row;
+    }
+  }
   
-  // initialise vector of particles
-  vector<Particle> particle_vec(rungs);
-  for (int r = 0; r < rungs; ++r) {
-    particle_vec[r].init(s);
+  // when streaming output to file, chains instead write into small buffers of
+  // output_block_rows rows per stored rung, which are emptied to disk as they
+  // fill up
+  int n_buffer = int(s.store_rungs.size())*s.output_block_rows;
+  if (streaming) {
+    stream_buffer = vector<vector<double>>(chains, vector<double>((s.d + 2)*n_buffer));
+    for (int c = 0; c < chains; ++c) {
+      loglike_ptr[c] = stream_buffer[c].data();
+      logprior_ptr[c] = stream_buffer[c].data() + n_buffer;
+      for (int i = 0; i < s.d; ++i) {
+        theta_ptr[c][i] = stream_buffer[c].data() + (i + 2)*n_buffer;
+      }
+    }
   }
   
-  // specify rung order
-  vector<int> rung_order = seq_int(0, rungs-1);
+  // create chains
+  chain_vec = vector<Chain>(chains);
+}
+
+//------------------------------------------------
+// initialise chain c, continuing from its checkpoint if resuming. Returns true
+// if the chain was resumed
+bool McmcRun::init_chain(int c) {
+  chain_vec[c].init(s_vec[c], loglike_ptr[c], logprior_ptr[c], theta_ptr[c]);
+  return s.resume && chain_vec[c].load_checkpoint();
+}
+
+//------------------------------------------------
+// return output of all chains, along with chain-level diagnostics
+Rcpp::List McmcRun::get_output() {
   
-  // objects for storing loglikelihood and theta values over iterations
-  vector<vector<double>> loglike_burnin(rungs, vector<double>(s.burnin));
-  vector<vector<double>> logprior_burnin(rungs, vector<double>(s.burnin));
-  vector<vector<vector<double>>> theta_burnin(rungs, vector<vector<double>>(s.burnin, vector<double>(d)));
-  vector<vector<double>> loglike_sampling(rungs, vector<double>(s.samples));
-  vector<vector<double>> logprior_sampling(rungs, vector<double>(s.samples));
-  vector<vector<vector<double>>> theta_sampling(rungs, vector<vector<double>>(s.samples, vector<double>(d)));
+  // chain-level diagnostics as list over chains
+  int chains = s.chains;
+  Rcpp::List chain_output(chains);
+  for (int c = 0; c < chains; ++c) {
+    Chain &ch = chain_vec[c];
+    
+    // per-rung loglikelihood summaries over sampling, in ladder order, and
+    // the resulting marginal likelihood
+    int rungs = s.rungs;
+    vector<double> loglike_mean(rungs), loglike_var(rungs), loglike_se(rungs);
+    for (int r = 0; r < rungs; ++r) {
+      loglike_mean[r] = ch.rung_loglike[r].get_mean();
+      loglike_var[r] = ch.rung_loglike[r].get_variance();
+      loglike_se[r] = ch.rung_loglike[r].get_se();
+    }
+    double log_ml, log_ml_se;
+    ch.get_marginal_likelihood(log_ml, log_ml_se);
+    Rcpp::List thermo = Rcpp::List::create(Rcpp::Named("loglike_mean") = loglike_mean,
+                                           Rcpp::Named("loglike_var") = loglike_var,
+                                           Rcpp::Named("loglike_se") = loglike_se,
+                                           Rcpp::Named("log_ml") = log_ml,
+                                           Rcpp::Named("log_ml_se") = log_ml_se);
+    
+    // effective sample size and autocorrelation of each parameter of the cold
+    // rung, with autocorrelations concatenated over parameters
+    vector<double> ess(s.d);
+    vector<double> acf;
+    for (int i = 0; i < s.d; ++i) {
+      ess[i] = ch.param_stats[i].get_ess();
+      vector<double> acf_i = ch.param_acf[i].get_acf();
+      acf.insert(acf.end(), acf_i.begin(), acf_i.end());
+    }
+    chain_output[c] = Rcpp::List::create(Rcpp::Named("beta_vec") = ch.get_beta_ladder(),
+                                         Rcpp::Named("mc_accept_burnin") = ch.mc_accept_burnin,
+                                         Rcpp::Named("mc_accept_sampling") = ch.mc_accept_sampling,
+                                         Rcpp::Named("accept_rate_burnin") = ch.accept_rate_burnin,
+                                         Rcpp::Named("accept_rate_sampling") = ch.accept_rate_sampling,
+                                         Rcpp::Named("screen_pass_burnin") = ch.screen_pass_burnin,
+                                         Rcpp::Named("screen_pass_sampling") = ch.screen_pass_sampling,
+                                         Rcpp::Named("screen_speedup_burnin") = ch.screen_speedup_burnin,
+                                         Rcpp::Named("screen_speedup_sampling") = ch.screen_speedup_sampling,
+                                         Rcpp::Named("burnin") = ch.burnin_end,
+                                         Rcpp::Named("time_burnin") = ch.time_burnin,
+                                         Rcpp::Named("time_sampling") = ch.time_sampling,
+                                         Rcpp::Named("thermo") = thermo,
+                                         Rcpp::Named("ess") = ess,
+                                         Rcpp::Named("acf") = acf);
+  }
   
-  // specify stored values at first iteration. Ensures that user-defined initial
-  // values are the first stored values
-  for (int r = 0; r < rungs; ++r) {
-    loglike_burnin[r][0] = particle_vec[r].loglike;
-    logprior_burnin[r][0] = particle_vec[r].logprior;
-    theta_burnin[r][0] = particle_vec[r].theta;
+  // split-Rhat of each parameter over the two halves of every chain
+  vector<double> rhat_vec(s.d);
+  for (int i = 0; i < s.d; ++i) {
+    vector<Welford> halves(2*chains);
+    for (int c = 0; c < chains; ++c) {
+      chain_vec[c].param_stats[i].get_halves(halves[2*c], halves[2*c + 1]);
+    }
+    rhat_vec[i] = rhat(halves);
   }
   
-  // store Metropolis coupling acceptance rates
-  vector<int> mc_accept_burnin(rungs - 1);
-  vector<int> mc_accept_sampling(rungs - 1);
+  // streamed output is returned as the paths of the output files, to be read
+  // back from R as needed. Otherwise output is returned in long form
+  Rcpp::List ret;
+  if (streaming) {
+    Rcpp::CharacterVector output_files(chains);
+    for (int c = 0; c < chains; ++c) {
+      output_files[c] = chain_vec[c].get_output_path();
+    }
+    ret = Rcpp::List::create(Rcpp::Named("output") = R_NilValue,
+                             Rcpp::Named("output_files") = output_files,
+                             Rcpp::Named("chain_output") = chain_output,
+                             Rcpp::Named("rhat") = rhat_vec);
+  } else {
+    vector<int> burnin_vec(chains);
+    for (int c = 0; c < chains; ++c) {
+      burnin_vec[c] = chain_vec[c].burnin_end;
+    }
+    Rcpp::List output = get_output_df(s, burnin_vec, loglike_col, logprior_col, theta_col);
+    ret = Rcpp::List::create(Rcpp::Named("output") = output,
+                             Rcpp::Named("chain_output") = chain_output,
+                             Rcpp::Named("rhat") = rhat_vec);
+  }
   
+  // evaluation counts and timings
+#ifdef MARKOVID_PROFILE
+  ret["profile"] = get_profile_output(chain_vec, s.d);
+#endif
   
-  // ---------- burn-in MCMC ----------
+  return ret;
+}
+
+//------------------------------------------------
+// run MCMC over all chains, using multiple threads if requested
+Rcpp::List run_mcmc_cpp(Rcpp::List args) {
+  
+  // start timer
+  chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+  
+  // load args and allocate output
+  McmcRun run(args);
+  System &s = run.s;
+  vector<Chain> &chain_vec = run.chain_vec;
   
-  // print message to console
+  // local copies of some parameters for convenience
+  int chains = s.chains;
+  int chain_threads = s.chain_threads;
+  
+  // rungs are parallelised within chains, which may themselves be running in
+  // parallel
+#ifdef _OPENMP
+  if (s.rung_threads > 1) {
+    omp_set_max_active_levels(2);
+  }
+#endif
+  
+  // run all chains
   if (!s.silent) {
-    print("MCMC chain", s.chain);
-    print("burn-in");
+    print("running", chains, (chains == 1) ? "chain on" : "chains on",
+          chain_threads*s.rung_threads, (chain_threads*s.rung_threads == 1) ? "thread" : "threads");
   }
+  vector<McmcRun *> run_vec = {&run};
+  vector<pair<int, int>> task_vec;
+  for (int c = 0; c < chains; ++c) {
+    task_vec.push_back(make_pair(0, c));
+  }
+  vector<string> error_message;
+  vector<char> resumed;
+  bool interrupted = run_chain_tasks(run_vec, task_vec, chain_threads, !s.silent,
+                                     s.pb_markdown, error_message, resumed);
   
-  // loop through burn-in iterations
-  for (int rep = 1; rep < s.burnin; ++rep) {
-    
-    // loop through rungs
-    for (int r = 0; r < rungs; ++r) {
-      
-      // update particles
-      particle_vec[rung_order[r]].update(beta_vec[rung_order[r]]);
-      
-      // store results
-      loglike_burnin[r][rep] = particle_vec[rung_order[r]].loglike;
-      logprior_burnin[r][rep] = particle_vec[rung_order[r]].logprior;
-      theta_burnin[r][rep] = particle_vec[rung_order[r]].theta;
+  for (int c = 0; c < chains; ++c) {
+    if (!error_message[c].empty()) {
+      Rcpp::stop("error in chain " + to_string(c + 1) + ": " + error_message[c]);
     }
-    
-    // perform Metropolis coupling
-    coupling(particle_vec, mc_accept_burnin, true, beta_vec, rung_order);
-    
-    // update progress bars
-    if (!s.silent) {
-      int remainder = rep % int(ceil(double(s.burnin)/100));
-      if ((remainder == 0 && !s.pb_markdown) || ((rep+1) == s.burnin)) {
-        update_progress(args_progress, "pb_burnin", rep+1, s.burnin, false);
-        if ((rep+1) == s.burnin) {
-          print("");
-        }
-      }
+  }
+  if (interrupted) {
+    if (!s.silent && !s.checkpoint_file.empty()) {
+      print("interrupted. Chains can be resumed from their last checkpoint");
     }
-    
-  }  // end burn-in MCMC loop
+    throw Rcpp::internal::InterruptedException();
+  }
   
   // print phase diagnostics
   if (!s.silent) {
-    double accept_rate = particle_vec[rungs-1].accept_count / double(s.burnin*d);
-    Rcpp::Rcout << "acceptance rate: " << round(accept_rate*1000) / 10.0 << "%\n";
+    for (int c = 0; c < chains; ++c) {
+      if (resumed[c]) {
+        print("chain", c + 1, "resumed from", chain_vec[c].get_checkpoint_path());
+      }
+      if (chain_vec[c].burnin_end < s.burnin) {
+        print("chain", c + 1, "converged after", chain_vec[c].burnin_end, "burn-in iterations");
+      }
+      Rcpp::Rcout << "chain " << c + 1 << " acceptance rate: burn-in "
+                  << round(chain_vec[c].accept_rate_burnin*1000) / 10.0 << "%, sampling "
+                  << round(chain_vec[c].accept_rate_sampling*1000) / 10.0 << "%\n";
+    }
+    print("");
   }
   
-  
-  // ---------- sampling MCMC ----------
-  
-  // print message to console
+  // end timer
   if (!s.silent) {
-    print("sampling phase");
+    chrono_timer(t1);
   }
   
-  // reset acceptance count of all rungs
-  for (int r = 0; r < rungs; ++r) {
-    particle_vec[r].accept_count = 0;
-  }
+  return run.get_output();
+}
+
+//------------------------------------------------
+// run MCMC over several datasets at once. All chains of all datasets are
+// scheduled as independent tasks over a single pool of threads, with idle
+// threads taking the next unstarted task, so that throughput is not held back
+// by datasets with few chains or slow likelihoods. The lookup table is shared
+// between all datasets with the same specification
+Rcpp::List run_mcmc_batch_cpp(Rcpp::List args_list, int threads, bool silent) {
   
-  // loop through sampling iterations
-  for (int rep = 0; rep < s.samples; ++rep) {
-    
-    // loop through rungs
-    for (int r = 0; r < rungs; ++r) {
-      
-      // update particles
-      particle_vec[rung_order[r]].update(beta_vec[rung_order[r]]);
-      
-      // store results
-      loglike_sampling[r][rep] = particle_vec[rung_order[r]].loglike;
-      logprior_sampling[r][rep] = particle_vec[rung_order[r]].logprior;
-      theta_sampling[r][rep] = particle_vec[rung_order[r]].theta;
-    }
-    
-    // perform Metropolis coupling
-    coupling(particle_vec, mc_accept_sampling, false, beta_vec, rung_order);
-    
-    // update progress bars
-    if (!s.silent) {
-      int remainder = rep % int(ceil(double(s.samples)/100));
-      if ((remainder == 0 && !s.pb_markdown) || ((rep+1) == s.samples)) {
-        update_progress(args_progress, "pb_samples", rep+1, s.samples, false);
-        if ((rep+1) == s.samples) {
-          print("");
-        }
-      }
-    }
-    
-  }  // end sampling MCMC loop
+  // start timer
+  chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
   
-  // print final diagnostics
-  if (!s.silent) {
-    double accept_rate = particle_vec[rung_order[rungs-1]].accept_count/double(s.samples*d);
-    Rcpp::Rcout << "acceptance rate: " << round(accept_rate*1000)/10.0 << "%\n";
+  // load args and allocate output of every dataset on the main thread
+  int n_data = args_list.size();
+  vector<unique_ptr<McmcRun>> run_vec(n_data);
+  vector<pair<int, int>> task_vec;
+  for (int i = 0; i < n_data; ++i) {
+    Rcpp::List args = args_list[i];
+    run_vec[i] = unique_ptr<McmcRun>(new McmcRun(args));
+    for (int c = 0; c < run_vec[i]->s.chains; ++c) {
+      task_vec.push_back(make_pair(i, c));
+    }
+  }
+  int n_task = int(task_vec.size());
+  if (!silent) {
+    print("running", n_task, "chains over", n_data, "datasets on", threads, "threads");
   }
   
+  // run tasks, with a single progress bar over all of them
+  vector<McmcRun *> run_ptr(n_data);
+  for (int i = 0; i < n_data; ++i) {
+    run_ptr[i] = run_vec[i].get();
+  }
+  vector<string> error_message;
+  vector<char> resumed;
+  bool interrupted = run_chain_tasks(run_ptr, task_vec, threads, !silent, false,
+                                     error_message, resumed);
   
-  // ---------- return ----------
+  for (int t = 0; t < n_task; ++t) {
+    if (!error_message[t].empty()) {
+      Rcpp::stop("error in dataset " + to_string(task_vec[t].first + 1) + ", chain " +
+                 to_string(task_vec[t].second + 1) + ": " + error_message[t]);
+    }
+  }
+  if (interrupted) {
+    throw Rcpp::internal::InterruptedException();
+  }
   
   // end timer
-  if (!s.silent) {
-    print("");
+  if (!silent) {
     chrono_timer(t1);
   }
   
-  // return as Rcpp list
-  Rcpp::List ret = Rcpp::List::create(Rcpp::Named("loglike_burnin") = loglike_burnin,
-                                      Rcpp::Named("logprior_burnin") = logprior_burnin,
-                                      Rcpp::Named("theta_burnin") = theta_burnin,
-                                      Rcpp::Named("loglike_sampling") = loglike_sampling,
-                                      Rcpp::Named("logprior_sampling") = logprior_sampling,
-                                      Rcpp::Named("theta_sampling") = theta_sampling,
-                                      Rcpp::Named("beta_vec") = beta_vec,
-                                      Rcpp::Named("mc_accept_burnin") = mc_accept_burnin,
-                                      Rcpp::Named("mc_accept_sampling") = mc_accept_sampling);
+  // return output of each dataset
+  Rcpp::List ret(n_data);
+  for (int i = 0; i < n_data; ++i) {
+    ret[i] = run_vec[i]->get_output();
+  }
   return ret;
 }
 
 //------------------------------------------------
-// Metropolis-coupling over temperature rungs
-void coupling(vector<Particle> &particle_vec, vector<int> &mc_accept, bool adaptive,
-              vector<double> &beta_vec, vector<int> &rung_order) {
+// assemble MCMC output into a long data.frame with columns chain, rung,
+// iteration, stage, logprior, loglikelihood, followed by one column per
+// parameter. Column names are attached in R. Chains whose burn-in stopped early
+// leave unused burn-in rows, which are dropped here
+Rcpp::List get_output_df(System &s, const vector<int> &burnin_vec,
+                         Rcpp::NumericVector &loglike_col,
+                         Rcpp::NumericVector &logprior_col,
+                         vector<Rcpp::NumericVector> &theta_col) {
   
-  // get number of rungs
-  int rungs = int(beta_vec.size());
+  int n_store = int(s.store_rungs.size());
   
-  // return if single rung
-  if (rungs == 1) {
-    return;
+  // stored burn-in iterations actually run by each chain
+  vector<int> n_store_burnin(s.chains);
+  int n_row = 0;
+  for (int c = 0; c < s.chains; ++c) {
+    n_store_burnin[c] = (burnin_vec[c] - 1) / s.thin + 1;
+    n_row += n_store*(n_store_burnin[c] + s.n_store_sampling);
   }
   
-  // loop over rungs, starting with the hottest chain and moving to the cold
-  // chain. Each time propose a swap with the next rung up
-  for (int i = 1; i < rungs; ++i) {
-    
-    // define rungs of interest
-    int rung1 = rung_order[i-1];
-    int rung2 = rung_order[i];
-    
-    // get log-likelihoods and beta values of two chains in the comparison
-    double loglike1 = particle_vec[rung1].loglike;
-    double loglike2 = particle_vec[rung2].loglike;
-    
-    double beta1 = beta_vec[rung1];
-    double beta2 = beta_vec[rung2];
-    
-    // calculate acceptance ratio (still in log space)
-    double acceptance = (loglike2*beta1 + loglike1*beta2) - (loglike1*beta1 + loglike2*beta2);
-    
-    // accept or reject move
-    bool accept_move = (log(runif_0_1()) < acceptance);
-    
-    // implement swap
-    if (accept_move) {
-      
-      // swap beta values
-      beta_vec[rung1] = beta2;
-      beta_vec[rung2] = beta1;
-      
-      // swap rung order
-      int tmp = rung_order[i-1];
-      rung_order[i-1] = rung_order[i];
-      rung_order[i] = tmp;
-      
-      // update acceptance rates
-      mc_accept[i-1]++;
-      
-      // adaptive update
-      if (adaptive) {
-        
-        
-        
-      }  // end adaptive update
-      
-    } else {  // if reject move
-      
-      // adaptive update
-      if (adaptive) {
-        
-      }  // end adaptive update
-      
+  // define names
+  Rcpp::CharacterVector chain_names(s.chains);
+  for (int c = 0; c < s.chains; ++c) {
+    chain_names[c] = "chain" + to_string(c + 1);
+  }
+  Rcpp::CharacterVector rung_names(n_store);
+  for (int j = 0; j < n_store; ++j) {
+    rung_names[j] = "rung" + to_string(s.store_rungs[j] + 1);
+  }
+  Rcpp::CharacterVector stage_names = Rcpp::CharacterVector::create("burnin", "sampling");
+  
+  // fill in index columns, and the rows of the output buffers that are kept.
+  // Rows are grouped by chain, then by rung, and then run over stored burn-in
+  // followed by sampling iterations
+  Rcpp::CharacterVector chain_col(n_row);
+  Rcpp::CharacterVector rung_col(n_row);
+  Rcpp::IntegerVector iteration_col(n_row);
+  Rcpp::CharacterVector stage_col(n_row);
+  vector<int> keep(n_row);
+  int row = 0;
+  for (int c = 0; c < s.chains; ++c) {
+    for (int j = 0; j < n_store; ++j) {
+      for (int k = 0; k < s.n_store_iter; ++k) {
+        bool is_burnin = (k < s.n_store_burnin);
+        if (is_burnin && (k >= n_store_burnin[c])) {
+          continue;
+        }
+        chain_col[row] = chain_names[c];
+        rung_col[row] = rung_names[j];
+        iteration_col[row] = is_burnin ? k*s.thin + 1 : burnin_vec[c] + (k - s.n_store_burnin)*s.thin + 1;
+        stage_col[row] = stage_names[is_burnin ? 0 : 1];
+        keep[row] = (c*n_store + j)*s.n_store_iter + k;
+        row++;
+      }
     }
-    
-    //print_vector(rung_order);
-    
-  }  // end loop over rungs
+  }
   
+  // value columns are returned as they are when every row is kept, and are
+  // otherwise copied down to the kept rows
+  Rcpp::List ret(6 + s.d);
+  vector<Rcpp::NumericVector *> value_col = {&logprior_col, &loglike_col};
+  for (int i = 0; i < s.d; ++i) {
+    value_col.push_back(&theta_col[i]);
+  }
+  for (int i = 0; i < (s.d + 2); ++i) {
+    if (n_row == s.chains*s.n_store_row) {
+      ret[4 + i] = *value_col[i];
+    } else {
+      Rcpp::NumericVector x(n_row);
+      for (int r = 0; r < n_row; ++r) {
+        x[r] = (*value_col[i])[keep[r]];
+      }
+      ret[4 + i] = x;
+    }
+  }
+  
+  // combine columns
+  ret[0] = chain_col;
+  ret[1] = rung_col;
+  ret[2] = iteration_col;
+  ret[3] = stage_col;
+  
+  // set attributes so that R sees a data.frame with compact row names
+  ret.attr("row.names") = Rcpp::IntegerVector::create(NA_INTEGER, -n_row);
+  ret.attr("class") = "data.frame";
+  
+  return ret;
 }
 
-
+//------------------------------------------------
+// sum the evaluation counts and timings of each chain over the chain itself
+// and all of its particles, and return as columns of two long data.frames, one
+// over components and one over parameters. Parameter names are attached in R
+#ifdef MARKOVID_PROFILE
+Rcpp::List get_profile_output(vector<Chain> &chain_vec, int d) {
+  
+  vector<string> component_names = {"spline", "binomial", "duration", "logprior",
+                                    "coupling", "progress"};
+  int chains = int(chain_vec.size());
+  
+  vector<int> comp_chain, param_chain, param_index;
+  vector<string> comp_name;
+  vector<double> comp_calls, comp_seconds, param_proposals, param_accepts, param_seconds;
+  for (int c = 0; c < chains; ++c) {
+    Profile total = chain_vec[c].profile;
+    for (Particle &particle : chain_vec[c].particle_vec) {
+      total.merge(particle.profile);
+    }
+    for (int k = 0; k < N_PROFILE; ++k) {
+      comp_chain.push_back(c + 1);
+      comp_name.push_back(component_names[k]);
+      comp_calls.push_back(double(total.calls[k]));
+      comp_seconds.push_back(total.seconds[k]);
+    }
+    for (int i = 0; i < d; ++i) {
+      param_chain.push_back(c + 1);
+      param_index.push_back(i + 1);
+      param_proposals.push_back(double(total.param_proposals[i]));
+      param_accepts.push_back(double(total.param_accepts[i]));
+      param_seconds.push_back(total.param_seconds[i]);
+    }
+  }
+  
+  Rcpp::List components = Rcpp::List::create(Rcpp::Named("chain") = comp_chain,
+                                             Rcpp::Named("component") = comp_name,
+                                             Rcpp::Named("calls") = comp_calls,
+                                             Rcpp::Named("seconds") = comp_seconds);
+  Rcpp::List parameters = Rcpp::List::create(Rcpp::Named("chain") = param_chain,
+                                             Rcpp::Named("param") = param_index,
+                                             Rcpp::Named("proposals") = param_proposals,
+                                             Rcpp::Named("accepts") = param_accepts,
+                                             Rcpp::Named("seconds") = param_seconds);
+  return Rcpp::List::create(Rcpp::Named("components") = components,
+                            Rcpp::Named("parameters") = parameters);
+}
+#endif
@@ -1,15 +1,74 @@
 
 #include "System.h"
-#include "Particle.h"
+#include "Chain.h"
+#include "run_tasks.h"
 
 #include <Rcpp.h>
 
 //------------------------------------------------
-// run MCMC
+// class holding everything needed to run all chains of a single MCMC and to
+// return its output to R. Output is allocated when the object is created,
+// which must be on the main thread. Chains can then be initialised and run on
+// any thread. Objects must not be copied once chains are initialised, as chains
+// point into the object's own copies of the system object
+class McmcRun {
+  
+public:
+  // PUBLIC OBJECTS
+  
+  // system object, and one copy per chain
+  System s;
+  std::vector<System> s_vec;
+  
+  // chains
+  std::vector<Chain> chain_vec;
+  
+  // output columns over all chains, or buffers per chain when streaming
+  bool streaming;
+  Rcpp::NumericVector loglike_col;
+  Rcpp::NumericVector logprior_col;
+  std::vector<Rcpp::NumericVector> theta_col;
+  std::vector<std::vector<double>> stream_buffer;
+  std::vector<double *> loglike_ptr;
+  std::vector<double *> logprior_ptr;
+  std::vector<std::vector<double *>> theta_ptr;
+  
+  
+  // PUBLIC FUNCTIONS
+  
+  // constructors
+  McmcRun(Rcpp::List args);
+  
+  // initialise chain c, continuing from its checkpoint if resuming
+  bool init_chain(int c);
+  
+  // output of all chains as returned to R
+  Rcpp::List get_output();
+  
+};
+
+//------------------------------------------------
+// run MCMC over all chains, using multiple threads if requested
 // [[Rcpp::export]]
 Rcpp::List run_mcmc_cpp(Rcpp::List args);
 
 //------------------------------------------------
-// Metropolis-coupling over temperature rungs
-void coupling(std::vector<Particle> &particle_vec, std::vector<int> &mc_accept, bool adaptive,
-              std::vector<double> &beta_vec, std::vector<int> &rung_order);
+// run MCMC over several datasets, with all chains of all datasets sharing a
+// single pool of threads
+// [[Rcpp::export]]
+Rcpp::List run_mcmc_batch_cpp(Rcpp::List args_list, int threads, bool silent);
+
+//------------------------------------------------
+// assemble MCMC output into a long data.frame, given the burn-in length run
+// by each chain
+Rcpp::List get_output_df(System &s, const std::vector<int> &burnin_vec,
+                         Rcpp::NumericVector &loglike_col,
+                         Rcpp::NumericVector &logprior_col,
+                         std::vector<Rcpp::NumericVector> &theta_col);
+
+//------------------------------------------------
+// evaluation counts and timings summed within each chain, when compiled with
+// profiling
+#ifdef MARKOVID_PROFILE
+Rcpp::List get_profile_output(std::vector<Chain> &chain_vec, int d);
+#endif
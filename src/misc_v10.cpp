@@ -2,6 +2,7 @@
 #include "misc_v10.h"
 
 #include <math.h>
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 
@@ -488,8 +489,8 @@ void cholesky(vector<vector<double>> &chol, const vector<vector<double>> &sigma)
 void cubic_spline(vector<double> &x, vector<double> &y,
                   vector<double> &x_pred, vector<double> &y_pred) {
   
-  // get vector sizes
-  int n = x.size();
+  // get vector sizes. n is the number of intervals between nodes
+  int n = int(x.size()) - 1;
   int n_pred = x_pred.size();
   
   // define objects for storing spline coefficients
@@ -533,3 +534,27 @@ void cubic_spline(vector<double> &x, vector<double> &y,
   
   return;
 }
+
+//------------------------------------------------
+// the natural cubic spline through fixed x-coordinates is linear in the
+// y-coordinates, and so can be written y_pred = basis * y. Given node
+// x-coordinates and prediction points x_pred, calculate this basis matrix and
+// save result into basis, stored in column-major order with one column of
+// length x_pred.size() per node. Column j is obtained as the spline through a
+// unit value at node j.
+void cubic_spline_basis(vector<double> &x, vector<double> &x_pred, vector<double> &basis) {
+  
+  int n = int(x.size());
+  int n_pred = int(x_pred.size());
+  basis = vector<double>(n*n_pred);
+  
+  vector<double> y(n);
+  vector<double> y_pred(n_pred);
+  for (int j = 0; j < n; ++j) {
+    fill(y.begin(), y.end(), 0.0);
+    y[j] = 1.0;
+    cubic_spline(x, y, x_pred, y_pred);
+    copy(y_pred.begin(), y_pred.end(), basis.begin() + j*n_pred);
+  }
+  
+}
@@ -1,11 +1,16 @@
 
 #pragma once
 
-// comment out this definition to switch from Rcpp to C++
+// comment out this definition to switch from Rcpp to C++. Standalone builds,
+// compiled with -DMARKOVID_STANDALONE, never use Rcpp
+#ifndef MARKOVID_STANDALONE
 #define RCPP_ACTIVE
+#endif
 
 #ifdef RCPP_ACTIVE
 #include <Rcpp.h>
+#else
+#include "Rmath_standalone.h"
 #endif
 
 #include <iostream>
@@ -14,6 +19,7 @@
 #include <limits>
 #include <chrono>
 #include <cfloat>
+#include <climits>
 
 //------------------------------------------------
 // define very large/small numbers for catching overflow/underflow problems
@@ -345,3 +351,13 @@ void cholesky(std::vector<std::vector<double>> &chol, const std::vector<std::vec
 // values in x_pred must be inside (or equal to) x.
 void cubic_spline(std::vector<double> &x, std::vector<double> &y,
                   std::vector<double> &x_pred, std::vector<double> &y_pred);
+
+//------------------------------------------------
+// the natural cubic spline through fixed x-coordinates is linear in the
+// y-coordinates, and so can be written y_pred = basis * y. Given node
+// x-coordinates and prediction points x_pred, calculate this basis matrix and
+// save result into basis, stored in column-major order with one column of
+// length x_pred.size() per node. Column j is obtained as the spline through a
+// unit value at node j.
+void cubic_spline_basis(std::vector<double> &x, std::vector<double> &x_pred,
+                        std::vector<double> &basis);
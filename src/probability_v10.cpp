@@ -2,71 +2,43 @@
 #include "probability_v10.h"
 #include "misc_v10.h"
 
-using namespace std;
+#include <stdexcept>
 
-// set random seed
-random_device rd;
-default_random_engine generator(rd());
+using namespace std;
 
 //------------------------------------------------
 // draw from continuous uniform distribution on interval [0,1)
-#ifdef RCPP_ACTIVE
-double runif_0_1() {
-  return R::runif(0,1);
+double runif_0_1(RNG &rng) {
+  return rng.runif_0_1();
 }
-#else
-double runif_0_1() {
-  uniform_real_distribution<double> uniform_0_1(0.0,1.0);
-  return uniform_0_1(generator);
-}
-#endif
 
 //------------------------------------------------
 // draw from continuous uniform distribution on interval [a,b)
-#ifdef RCPP_ACTIVE
-double runif1(double a, double b) {
-  return R::runif(a,b);
+double runif1(RNG &rng, double a, double b) {
+  return a + (b - a)*rng.runif_0_1();
 }
-#else
-double runif1(double a, double b) {
-  uniform_real_distribution<double> uniform_a_b(a,b);
-  return uniform_a_b(generator);
-}
-#endif
 
 //------------------------------------------------
-// draw from Bernoulli(p) distribution
-#ifdef RCPP_ACTIVE
-bool rbernoulli1(double p) {
-  return R::rbinom(1, p);
+// draw from Bernoulli(p) distribution. Draws use only the uniform stream of
+// rng, so they do not depend on the standard library
+bool rbernoulli1(RNG &rng, double p) {
+  return rng.runif_0_1() < p;
 }
-#else
-bool rbernoulli1(double p) {
-  bernoulli_distribution dist_bernoulli(p);
-  return dist_bernoulli(generator);
-}
-#endif
 
 //------------------------------------------------
 // draw from binomial(N,p) distribution
-#ifdef RCPP_ACTIVE
-int rbinom1(int N, double p) {
-  return R::rbinom(N, p);
-}
-#else
-int rbinom1(int N, double p) {
+int rbinom1(RNG &rng, int N, double p) {
   binomial_distribution<int> dist_binom(N, p);
-  return dist_binom(generator);
+  return dist_binom(rng);
 }
-#endif
 
 //------------------------------------------------
 // draw from multinomial(N,p) distribution, where p sums to p_sum
-vector<int> rmultinom1(int N, const vector<double> &p, double p_sum) {
+vector<int> rmultinom1(RNG &rng, int N, const vector<double> &p, double p_sum) {
   int k = int(p.size());
   vector<int> ret(k);
   for (int i = 0; i < (k-1); ++i) {
-    ret[i] = rbinom1(N, p[i]/p_sum);
+    ret[i] = rbinom1(rng, N, p[i]/p_sum);
     N -= ret[i];
     if (N == 0) {
       break;
@@ -79,23 +51,16 @@ vector<int> rmultinom1(int N, const vector<double> &p, double p_sum) {
 
 //------------------------------------------------
 // draw from univariate normal distribution
-#ifdef RCPP_ACTIVE
-double rnorm1(double mean, double sd) {
-  return R::rnorm(mean, sd);
-}
-#else
-double rnorm1(double mean, double sd) {
-  normal_distribution<double> dist_norm(mean,sd);
-  return dist_norm(generator);
+double rnorm1(RNG &rng, double mean, double sd) {
+  return mean + sd*rng.rnorm();
 }
-#endif
 
 //------------------------------------------------
 // draw from univariate normal distribution and reflect to interval (a,b)
-double rnorm1_interval(double mean, double sd, double a, double b) {
+double rnorm1_interval(RNG &rng, double mean, double sd, double a, double b) {
   
   // draw raw value relative to a
-  double ret = rnorm1(mean, sd) - a;
+  double ret = rnorm1(rng, mean, sd) - a;
   
   // reflect off boundries at 0 and (b-a)
   if (ret < 0 || ret > (b-a)) {
@@ -134,14 +99,14 @@ double rnorm1_interval(double mean, double sd, double a, double b) {
 // variance/covariance matrix sigma*scale^2. The inputs consist of mu,
 // sigma_chol, and scale, where sigma_chol is the Cholesky decomposition of
 // sigma. Output values are stored in x.
-void rmnorm1(vector<double> &x, const vector<double> &mu,
+void rmnorm1(RNG &rng, vector<double> &x, const vector<double> &mu,
              const vector<vector<double>> &sigma_chol, double scale) {
   
   int d = int(mu.size());
   x = mu;
   double z;
   for (int j = 0; j < d; j++) {
-    z = rnorm1();
+    z = rnorm1(rng);
     for (int i = j; i < d; i++) {
       x[i] += sigma_chol[i][j]*scale*z;
     }
@@ -157,8 +122,8 @@ void rmnorm1(vector<double> &x, const vector<double> &mu,
 // sample single value from given probability vector (that sums to p_sum).
 // Starting in probability_v10 the first value returned from this vector is 0
 // rather than 1 (i.e. moving to C++-style zero-based indexing)
-int sample1(const vector<double> &p, double p_sum) {
-  double rand = p_sum*runif_0_1();
+int sample1(RNG &rng, const vector<double> &p, double p_sum) {
+  double rand = p_sum*runif_0_1(rng);
   double z = 0;
   for (int i=0; i<int(p.size()); i++) {
     z += p[i];
@@ -169,12 +134,12 @@ int sample1(const vector<double> &p, double p_sum) {
 #ifdef RCPP_ACTIVE
   Rcpp::stop("error in sample1(), ran off end of probability vector");
 #else
-  stop("error in sample1(), ran off end of probability vector");
+  throw runtime_error("error in sample1(), ran off end of probability vector");
 #endif
   return 0;
 }
-int sample1(const vector<int> &p, int p_sum) {
-  int rand = sample2(1,p_sum);
+int sample1(RNG &rng, const vector<int> &p, int p_sum) {
+  int rand = sample2(rng, 1,p_sum);
   int z = 0;
   for (int i=0; i<int(p.size()); i++) {
     z += p[i];
@@ -185,7 +150,7 @@ int sample1(const vector<int> &p, int p_sum) {
 #ifdef RCPP_ACTIVE
   Rcpp::stop("error in sample1(), ran off end of probability vector");
 #else
-  stop("error in sample1(), ran off end of probability vector");
+  throw runtime_error("error in sample1(), ran off end of probability vector");
 #endif
   return 0;
 }
@@ -193,8 +158,8 @@ int sample1(const vector<int> &p, int p_sum) {
 //------------------------------------------------
 // sample single value x that lies between a and b (inclusive) with equal
 // probability
-int sample2(int a, int b) {
-  return floor(runif1(a, b+1));
+int sample2(RNG &rng, int a, int b) {
+  return floor(runif1(rng, a, b+1));
 }
 
 //------------------------------------------------
@@ -202,11 +167,11 @@ int sample2(int a, int b) {
 // sums to p_sum. Results are stored in ret (passed in by reference), and the
 // number of draws is dictated by the length of this vector. Option to return
 // vector in shuffled order
-void sample3(vector<int> &ret, const vector<double> &p, double p_sum, bool return_shuffled) {
+void sample3(RNG &rng, vector<int> &ret, const vector<double> &p, double p_sum, bool return_shuffled) {
   int n = int(ret.size());
   int j = 0;
   for (int i = 0; i < int(p.size()); ++i) {
-    int n_i = rbinom1(n, p[i]/p_sum);
+    int n_i = rbinom1(rng, n, p[i]/p_sum);
     if (n_i > 0) {
       fill(ret.begin()+j, ret.begin()+j+n_i, i);
       j += n_i;
@@ -218,21 +183,25 @@ void sample3(vector<int> &ret, const vector<double> &p, double p_sum, bool retur
     p_sum -= p[i];
   }
   if (return_shuffled) {
-    reshuffle(ret);
+    reshuffle(rng, ret);
   }
 }
 
 //------------------------------------------------
 // equivalent to sample2, but draws n values without replacement
-vector<int> sample4(int n, int a, int b) {
+vector<int> sample4(RNG &rng, int n, int a, int b) {
   vector<int> ret(n);
   int t = 0, m = 0;
   int N = b - a + 1;
   if (n > N) {
+#ifdef RCPP_ACTIVE
     Rcpp::stop("error in sample4(), attempt to sample more elements than are available");
+#else
+    throw runtime_error("error in sample4(), attempt to sample more elements than are available");
+#endif
   }
   for (int i = 0; i < N; ++i) {
-    if (sample2(1, N-t) <= (n-m)) {
+    if (sample2(rng, 1, N-t) <= (n-m)) {
       ret[m] = a + i;
       m++;
       if (m == n) {
@@ -245,17 +214,38 @@ vector<int> sample4(int n, int a, int b) {
 }
 
 //------------------------------------------------
-// draw from gamma(shape,rate) distribution
-#ifdef RCPP_ACTIVE
-double rgamma1(double shape, double rate) {
-  return(R::rgamma(shape, 1.0/rate));
-}
-#else
-double rgamma1(double shape, double rate) {
-  gamma_distribution<double> rgamma(shape, 1.0/rate);
-  double x = rgamma(generator);
+// draw from gamma(shape,rate) distribution by the method of Marsaglia and
+// Tsang (2000). Draws use only the uniform and normal streams of rng, so they
+// do not depend on the standard library
+double rgamma1(RNG &rng, double shape, double rate) {
   
-  // check for zero or infinite values (catches bug present in Visual Studio 2010)
+  // shapes below one are drawn as gamma(shape+1) multiplied by U^(1/shape)
+  double boost = 1.0;
+  if (shape < 1.0) {
+    boost = pow(1.0 - rng.runif_0_1(), 1.0/shape);
+    shape += 1.0;
+  }
+  
+  // squeeze and rejection steps
+  double d = shape - 1.0/3.0;
+  double c = 1.0/sqrt(9.0*d);
+  double x = 0.0;
+  while (true) {
+    double z = rng.rnorm();
+    double v = 1.0 + c*z;
+    if (v <= 0) {
+      continue;
+    }
+    v = v*v*v;
+    double u = rng.runif_0_1();
+    double z2 = z*z;
+    if ((u < 1.0 - 0.0331*z2*z2) || (log(u) < 0.5*z2 + d*(1.0 - v + log(v)))) {
+      x = boost*d*v/rate;
+      break;
+    }
+  }
+  
+  // check for zero or infinite values
   if (x == 0) {
     x = UNDERFLO_DOUBLE;
   }
@@ -265,49 +255,31 @@ double rgamma1(double shape, double rate) {
   
   return x;
 }
-#endif
 
 
 //------------------------------------------------
 // draw from beta(shape1,shape2) distribution
-#ifdef RCPP_ACTIVE
-double rbeta1(double shape1, double shape2) {
-  return R::rbeta(shape1, shape2);
-}
-#else
-double rbeta1(double shape1, double shape2) {
-  double x1 = rgamma1(shape1, 1.0);
-  double x2 = rgamma1(shape2, 1.0);
+double rbeta1(RNG &rng, double shape1, double shape2) {
+  double x1 = rgamma1(rng, shape1, 1.0);
+  double x2 = rgamma1(rng, shape2, 1.0);
   return x1/double(x1+x2);
 }
-#endif
 
 //------------------------------------------------
 // draw from Poisson distribution with rate lambda
-#ifdef RCPP_ACTIVE
-int rpois1(double lambda) {
-  return R::rpois(lambda);
-}
-#else
-int rpois1(double lambda) {
-  Rcpp::stop("C++ version of poisson draws not coded yet!");
+int rpois1(RNG &rng, double lambda) {
+  poisson_distribution<int> dist_pois(lambda);
+  return dist_pois(rng);
 }
-#endif
 
 //------------------------------------------------
 // draw from zero-truncated Poisson distribution with rate lambda
 // mean = lambda/(1 -exp(-lambda))
-#ifdef RCPP_ACTIVE
-int rztpois1(double lambda) {
-  double rnd1 = runif_0_1();
+int rztpois1(RNG &rng, double lambda) {
+  double rnd1 = runif_0_1(rng);
   double t = -log(1 - rnd1*(1 - exp(-lambda)));
-  return R::rpois(lambda - t) + 1;
+  return rpois1(rng, lambda - t) + 1;
 }
-#else
-int rztpois1(double lambda) {
-  Rcpp::stop("C++ version of zero-truncated poisson draws not coded yet!");
-}
-#endif
 
 //------------------------------------------------
 // probability mass of Poisson distribution
@@ -327,11 +299,11 @@ double dpois1(int n, double lambda, bool return_log) {
 
 //------------------------------------------------
 // draw from symmetric dichlet(alpha) distribution of length n
-vector<double> rdirichlet1(double alpha, int n) {
+vector<double> rdirichlet1(RNG &rng, double alpha, int n) {
   vector<double> ret(n);
   double retSum = 0;
   for (int i=0; i<n; i++) {
-    ret[i] = rgamma1(alpha,1.0);
+    ret[i] = rgamma1(rng, alpha,1.0);
     retSum += ret[i];
   }
   for (int i=0; i<n; i++) {
@@ -342,29 +314,17 @@ vector<double> rdirichlet1(double alpha, int n) {
 
 //------------------------------------------------
 // draw from Geometric(p) distribution, with mean (1-p)/p
-#ifdef RCPP_ACTIVE
-int rgeom1(const double p) {
-  return R::rgeom(p);
-}
-#else
-int rgeom1(const double p) {
+int rgeom1(RNG &rng, const double p) {
   geometric_distribution<int> dist_geom(p);
-  return dist_geom(generator);
+  return dist_geom(rng);
 }
-#endif
 
 //------------------------------------------------
 // draw from exponential(r) distribution
-#ifdef RCPP_ACTIVE
-double rexp1(const double r) {
-  return R::rexp(1/r);
-}
-#else
-double rexp1(const double r) {
+double rexp1(RNG &rng, const double r) {
   exponential_distribution<double> dist_exponential(r);
-  return dist_exponential(generator);
+  return dist_exponential(rng);
 }
-#endif
 
 //------------------------------------------------
 // binomial coeffiient n choose k
@@ -1,45 +1,47 @@
 
 #pragma once
 
+#include "RNG.h"
+
 #include <vector>
 #include <random>
 #include <math.h>
 
 //------------------------------------------------
-double runif_0_1();
+double runif_0_1(RNG &rng);
 
 //------------------------------------------------
-double runif1(double a, double b);
+double runif1(RNG &rng, double a, double b);
 
 //------------------------------------------------
-bool rbernoulli1(double p);
+bool rbernoulli1(RNG &rng, double p);
 
 //------------------------------------------------
-int rbinom1(int N, double p);
+int rbinom1(RNG &rng, int N, double p);
 
 //------------------------------------------------
-std::vector<int> rmultinom1(int N, const std::vector<double> &p, double p_sum = 1.0);
+std::vector<int> rmultinom1(RNG &rng, int N, const std::vector<double> &p, double p_sum = 1.0);
 
 //------------------------------------------------
-double rnorm1(double mean = 0.0, double sd = 1.0);
+double rnorm1(RNG &rng, double mean = 0.0, double sd = 1.0);
 
 //------------------------------------------------
-double rnorm1_interval(double mean, double sd, double a, double b);
+double rnorm1_interval(RNG &rng, double mean, double sd, double a, double b);
 
 //------------------------------------------------
-void rmnorm1(std::vector<double> &x, const std::vector<double> &mu,
+void rmnorm1(RNG &rng, std::vector<double> &x, const std::vector<double> &mu,
              const std::vector<std::vector<double>> &sigma_chol, double scale = 1.0);
 
 //------------------------------------------------
 template<class TYPE>
-void reshuffle(std::vector<TYPE> &x) {
+void reshuffle(RNG &rng, std::vector<TYPE> &x) {
   int rnd1;
   TYPE tmp1;
   int n = int(x.size());
   for (int i = 0; i < n; ++i) {
     
     // draw random index from i to end of vector
-    rnd1 = floor(runif1(i, n));
+    rnd1 = floor(runif1(rng, i, n));
     
     // swap for value at position i
     tmp1 = x[rnd1];
@@ -49,41 +51,41 @@ void reshuffle(std::vector<TYPE> &x) {
 }
 
 //------------------------------------------------
-int sample1(const std::vector<double> &p, double p_sum = 1.0);
+int sample1(RNG &rng, const std::vector<double> &p, double p_sum = 1.0);
 
 //------------------------------------------------
-int sample2(int a, int b);
+int sample2(RNG &rng, int a, int b);
 
 //------------------------------------------------
-void sample3(std::vector<int> &ret, const std::vector<double> &p,
+void sample3(RNG &rng, std::vector<int> &ret, const std::vector<double> &p,
              double p_sum = 1.0, bool return_shuffled = true);
 
 //------------------------------------------------
-std::vector<int> sample4(int n, int a, int b);
+std::vector<int> sample4(RNG &rng, int n, int a, int b);
 
 //------------------------------------------------
-double rgamma1(double shape, double rate);
+double rgamma1(RNG &rng, double shape, double rate);
 
 //------------------------------------------------
-double rbeta1(double shape1, double shape2);
+double rbeta1(RNG &rng, double shape1, double shape2);
 
 //------------------------------------------------
-int rpois1(double lambda);
+int rpois1(RNG &rng, double lambda);
 
 //------------------------------------------------
-int rztpois1(double lambda);
+int rztpois1(RNG &rng, double lambda);
 
 //------------------------------------------------
 double dpois1(int n, double lambda, bool return_log);
 
 //------------------------------------------------
-std::vector<double> rdirichlet1(double alpha, int n);
+std::vector<double> rdirichlet1(RNG &rng, double alpha, int n);
 
 //------------------------------------------------
-int rgeom1(const double p);
+int rgeom1(RNG &rng, const double p);
 
 //------------------------------------------------
-double rexp1(const double r);
+double rexp1(RNG &rng, const double r);
 
 //------------------------------------------------
 int choose(int n, int k);
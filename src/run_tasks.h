@@ -0,0 +1,86 @@
+
+#pragma once
+
+#include "System.h"
+#include "Chain.h"
+#include "Progress.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <atomic>
+#include <exception>
+#include <string>
+#include <utility>
+#include <vector>
+
+//------------------------------------------------
+// run chains as independent tasks over a pool of threads, with idle threads
+// taking the next unstarted task. Progress of all tasks is reported from the
+// main thread, which polls for user interrupts in between running its own
+// tasks and once it has run out of tasks. After an interrupt no further tasks
+// are started, and running chains stop at the end of their current iteration.
+// Errors cannot be passed back to R from within worker threads, so are caught
+// and returned as one message per task. Returns true if interrupted.
+//
+// task_vec[t] gives the run and chain of task t. RUN can be any type holding a
+// System object s and a vector of chains chain_vec, with a method init_chain(c)
+// that initialises chain c and returns true if it was resumed from a checkpoint
+template<class RUN>
+bool run_chain_tasks(std::vector<RUN *> &run_vec, const std::vector<std::pair<int, int>> &task_vec,
+                     int threads, bool draw_bar, bool markdown,
+                     std::vector<std::string> &error_message, std::vector<char> &resumed) {
+  
+  // total iterations of each task
+  int n_task = int(task_vec.size());
+  std::vector<int> total(n_task);
+  for (int t = 0; t < n_task; ++t) {
+    System &s = run_vec[task_vec[t].first]->s;
+    total[t] = s.burnin + s.samples;
+  }
+  Progress progress(total, draw_bar, markdown);
+  error_message = std::vector<std::string>(n_task);
+  resumed = std::vector<char>(n_task);
+  std::atomic<int> next_task(0);
+  
+#ifdef _OPENMP
+#pragma omp parallel num_threads(threads)
+#endif
+  {
+    for (int t = next_task.fetch_add(1); t < n_task; t = next_task.fetch_add(1)) {
+      RUN &run = *run_vec[task_vec[t].first];
+      int c = task_vec[t].second;
+      try {
+        if (!progress.is_interrupted()) {
+          resumed[t] = run.init_chain(c);
+          
+          // chains resumed from a checkpoint start from their completed
+          // iterations
+          Chain &chain = run.chain_vec[c];
+          int burnin_done = (chain.burnin_done == chain.burnin_end) ? run.s.burnin : chain.burnin_done;
+          progress.update(t, burnin_done + chain.sampling_done);
+          
+          chain.run_burnin(&progress, t);
+          if (!progress.is_interrupted()) {
+            chain.run_sampling(&progress, t);
+          }
+        }
+      } catch (std::exception &e) {
+        error_message[t] = e.what();
+      }
+      progress.finish(t);
+    }
+    
+    // the main thread keeps reporting until all tasks have finished
+    bool is_main = true;
+#ifdef _OPENMP
+    is_main = (omp_get_thread_num() == 0);
+#endif
+    if (is_main) {
+      progress.wait();
+    }
+  }
+  
+  return progress.is_interrupted();
+}
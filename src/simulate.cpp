@@ -0,0 +1,191 @@
+
+#include "simulate.h"
+#include "aggregate.h"
+#include "misc_v10.h"
+#include "probability_v10.h"
+#include "RNG.h"
+
+#include <math.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+//------------------------------------------------
+// draw a whole number of days from the Erlang distribution of mean m and given
+// shape. Rounding down matches the likelihood, under which the density on
+// day x is the probability of falling in [x, x+1)
+inline double rdelay(RNG &rng, double m, double shape) {
+  if (!(m > 0)) {
+    return 0.0;
+  }
+  return floor(rgamma1(rng, shape, shape/m));
+}
+
+//------------------------------------------------
+// simulate replicate datasets and aggregate each one on the fly
+void sim_aggregate_reps(const vector<double> &theta, vector<double> &node_x,
+                        const vector<int> &age_vec, const vector<double> &age,
+                        const vector<double> &date_admission,
+                        const vector<double> &date_censor, int reps, int t_max,
+                        bool interp_s, unsigned int seed, int threads,
+                        vector<vector<int>> &count) {
+  
+  int n = int(age.size());
+  int n_age = int(age_vec.size());
+  int n_node = int(node_x.size());
+  int n_trans = 4;
+  int n_dur = N_DUR_COUNT;
+  int m_offset = n_trans*n_node;
+  int s_offset = m_offset + n_dur;
+  
+  // transition probabilities at each age, from the logistic transformed spline
+  // through the node values
+  vector<double> age_seq(age_vec.begin(), age_vec.end());
+  vector<double> basis;
+  cubic_spline_basis(node_x, age_seq, basis);
+  vector<vector<double>> p(n_trans, vector<double>(n_age));
+  for (int t = 0; t < n_trans; ++t) {
+    for (int i = 0; i < n_age; ++i) {
+      double x = 0.0;
+      for (int j = 0; j < n_node; ++j) {
+        x += basis[j*n_age + i]*theta[t*n_node + j];
+      }
+      p[t][i] = 1.0/(1.0 + exp(-x));
+    }
+  }
+  const double *p_AI = p[0].data();
+  const double *p_AD = p[1].data();
+  const double *p_ID = p[2].data();
+  const double *p_SD = p[3].data();
+  
+  // means and Erlang shapes of durations, using the same mapping from shape
+  // index to shape as the likelihood
+  vector<double> m(n_dur), shape(n_dur);
+  for (int j = 0; j < n_dur; ++j) {
+    m[j] = theta[m_offset + j];
+    double s = theta[s_offset + j];
+    shape[j] = interp_s ? s + 1 : floor(s) + 1;
+  }
+  
+  // position in age_vec of each patient, which is checked in R
+  vector<vector<int>> age_pos = get_age_pos(age_vec);
+  vector<int> w_age(n);
+  for (int r = 0; r < n; ++r) {
+    w_age[r] = age_pos[int(age[r])][0];
+  }
+  
+  // random number streams are derived from the seed, with each replicate
+  // separated from the last by a long jump. Replicates therefore give the same
+  // results irrespective of the number of threads
+  vector<RNG> rng_vec(reps);
+  RNG stream(seed);
+  for (int k = 0; k < reps; ++k) {
+    rng_vec[k] = stream;
+    stream.long_jump();
+  }
+  
+  // simulate and count each replicate
+  int n_count = N_TRANS_COUNT*n_age + N_DUR_COUNT*t_max;
+  count = vector<vector<int>>(reps, vector<int>(n_count));
+  
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 1)
+#endif
+  for (int k = 0; k < reps; ++k) {
+    RNG &rng = rng_vec[k];
+    int *trans = count[k].data();
+    int *hist = count[k].data() + N_TRANS_COUNT*n_age;
+    
+    for (int r = 0; r < n; ++r) {
+      int i = w_age[r];
+      
+      // draw progression route and the dates along it. Routes are coded as in
+      // aggregate_indlevel_rows()
+      int icu = rbernoulli1(rng, p_AI[i]);
+      int stepdown = NA_INTEGER;
+      int outcome;
+      double date_icu = NA_REAL;
+      double date_stepdown = NA_REAL;
+      double date_final_outcome;
+      if (icu == 0) {
+        if (rbernoulli1(rng, p_AD[i])) {
+          outcome = 1;
+          date_final_outcome = date_admission[r] + rdelay(rng, m[M_AD], shape[M_AD]);
+        } else {
+          outcome = 2;
+          date_final_outcome = date_admission[r] + rdelay(rng, m[M_AC], shape[M_AC]);
+        }
+      } else {
+        date_icu = date_admission[r] + rdelay(rng, m[M_AI], shape[M_AI]);
+        if (rbernoulli1(rng, p_ID[i])) {
+          stepdown = 0;
+          outcome = 1;
+          date_final_outcome = date_icu + rdelay(rng, m[M_ID], shape[M_ID]);
+        } else {
+          stepdown = 1;
+          if (rbernoulli1(rng, p_SD[i])) {
+            outcome = 1;
+            date_stepdown = date_icu + rdelay(rng, m[M_I1S], shape[M_I1S]);
+            date_final_outcome = date_stepdown + rdelay(rng, m[M_SD], shape[M_SD]);
+          } else {
+            outcome = 2;
+            date_stepdown = date_icu + rdelay(rng, m[M_I2S], shape[M_I2S]);
+            date_final_outcome = date_stepdown + rdelay(rng, m[M_SC], shape[M_SC]);
+          }
+        }
+      }
+      
+      // apply censoring, each event being censored independently as in
+      // sim_indlevel()
+      if (date_icu > date_censor[r]) {
+        icu = NA_INTEGER;
+      }
+      if (date_stepdown > date_censor[r]) {
+        stepdown = NA_INTEGER;
+      }
+      if (date_final_outcome > date_censor[r]) {
+        outcome = NA_INTEGER;
+      }
+      
+      count_indlevel_row(age[r], icu, stepdown, outcome, date_admission[r], date_icu,
+                         date_stepdown, date_final_outcome, age_pos, n_age, t_max,
+                         trans, hist);
+    }
+  }
+  
+}
+
+//------------------------------------------------
+// simulate replicate datasets from the hospital progression model, aggregated
+// in the same format as aggregate_indlevel()
+Rcpp::List sim_aggregate_cpp(Rcpp::List args) {
+  
+  // extract inputs
+  vector<double> theta = rcpp_to_vector_double(args["theta"]);
+  vector<double> node_x = rcpp_to_vector_double(args["node_x"]);
+  vector<int> age_vec = rcpp_to_vector_int(args["age_vec"]);
+  vector<double> age = rcpp_to_vector_double(args["age"]);
+  vector<double> date_admission = rcpp_to_vector_double(args["date_admission"]);
+  vector<double> date_censor = rcpp_to_vector_double(args["date_censor"]);
+  int reps = rcpp_to_int(args["reps"]);
+  int t_max = rcpp_to_int(args["t_max"]);
+  bool interp_s = rcpp_to_bool(args["interp_s"]);
+  unsigned int seed = rcpp_to_int(args["seed"]);
+  int threads = rcpp_to_int(args["threads"]);
+  
+  // simulate and count
+  vector<vector<int>> count;
+  sim_aggregate_reps(theta, node_x, age_vec, age, date_admission, date_censor,
+                     reps, t_max, interp_s, seed, threads, count);
+  
+  // return aggregated data of each replicate
+  int n_age = int(age_vec.size());
+  Rcpp::List ret(reps);
+  for (int k = 0; k < reps; ++k) {
+    ret[k] = get_indlevel_list(count[k], n_age, t_max);
+  }
+  return ret;
+}
@@ -0,0 +1,29 @@
+
+#pragma once
+
+#include <Rcpp.h>
+
+#include <vector>
+
+//------------------------------------------------
+// simulate replicate datasets from the hospital progression model, aggregating
+// each one into transition counts by age and duration histograms without
+// forming a line list. Parameters follow the layout of theta used within the
+// MCMC: spline node values of the AI, AD, ID and SD transitions on the logit
+// scale, followed by the mean and then the shape index of each Erlang
+// duration. One patient is simulated per element of age, date_admission and
+// date_censor, and every age must appear in age_vec. On return count holds one
+// vector per replicate, laid out as by aggregate_indlevel_rows(). Replicates
+// are split over threads, each drawing from its own random number stream
+void sim_aggregate_reps(const std::vector<double> &theta, std::vector<double> &node_x,
+                        const std::vector<int> &age_vec, const std::vector<double> &age,
+                        const std::vector<double> &date_admission,
+                        const std::vector<double> &date_censor, int reps, int t_max,
+                        bool interp_s, unsigned int seed, int threads,
+                        std::vector<std::vector<int>> &count);
+
+//------------------------------------------------
+// simulate replicate datasets from the hospital progression model and return
+// each one in the same format as aggregate_indlevel()
+// [[Rcpp::export]]
+Rcpp::List sim_aggregate_cpp(Rcpp::List args);
@@ -0,0 +1,98 @@
+
+#include "spline_summary.h"
+#include "misc_v10.h"
+
+#include <math.h>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+//------------------------------------------------
+// type 7 quantile of the n values of x, reordering x in the process. Follows
+// the arithmetic of R's quantile(), interpolating between the order statistics
+// either side of 1 + (n - 1)*p only when they differ
+static double quantile_type7(double *x, int n, double p) {
+  double index = (n - 1)*p;
+  int lo = int(floor(index));
+  int hi = int(ceil(index));
+  nth_element(x, x + lo, x + n);
+  double q = x[lo];
+  if (hi > lo) {
+    double x_hi = *min_element(x + lo + 1, x + n);
+    if ((index > lo) && (x_hi != q)) {
+      double h = index - lo;
+      q = (1 - h)*q + h*x_hi;
+    }
+  }
+  return q;
+}
+
+//------------------------------------------------
+// quantiles over posterior draws of a logistic-transformed spline at each age
+void spline_quantiles(const double *nodes, int n_draws, vector<double> &node_x,
+                      vector<double> &age_vec, double scale,
+                      const vector<double> &probs, int threads,
+                      vector<double> &ret) {
+  
+  int n_node = int(node_x.size());
+  int n_age = int(age_vec.size());
+  int n_prob = int(probs.size());
+  vector<double> basis;
+  cubic_spline_basis(node_x, age_vec, basis);
+  ret = vector<double>(n_age*n_prob);
+  
+#ifdef _OPENMP
+#pragma omp parallel num_threads(threads)
+#endif
+  {
+    vector<double> x(n_draws);
+    
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+    for (int a = 0; a < n_age; ++a) {
+      
+      // spline values of every draw at this age, accumulated one node at a
+      // time so that the inner loop runs over contiguous draws
+      fill(x.begin(), x.end(), 0.0);
+      for (int j = 0; j < n_node; ++j) {
+        double b = basis[j*n_age + a];
+        const double *col = nodes + j*n_draws;
+        for (int i = 0; i < n_draws; ++i) {
+          x[i] += b*col[i];
+        }
+      }
+      for (int i = 0; i < n_draws; ++i) {
+        x[i] = scale / (1 + exp(-x[i]));
+      }
+      
+      for (int k = 0; k < n_prob; ++k) {
+        ret[k*n_age + a] = quantile_type7(x.data(), n_draws, probs[k]);
+      }
+    }
+  }
+  
+}
+
+//------------------------------------------------
+// quantiles over posterior draws of a logistic-transformed spline at each age.
+// Node values arrive as an R matrix of draws by nodes
+Rcpp::List spline_quantiles_cpp(Rcpp::List args) {
+  
+  Rcpp::NumericMatrix nodes = args["nodes"];
+  vector<double> node_x = rcpp_to_vector_double(args["node_x"]);
+  vector<double> age_vec = rcpp_to_vector_double(args["age_vec"]);
+  double scale = rcpp_to_double(args["scale"]);
+  vector<double> probs = rcpp_to_vector_double(args["probs"]);
+  int threads = rcpp_to_int(args["threads"]);
+  
+  vector<double> quantiles;
+  spline_quantiles(nodes.begin(), nodes.nrow(), node_x, age_vec, scale, probs,
+                   threads, quantiles);
+  
+  return Rcpp::List::create(Rcpp::Named("quantiles") = quantiles);
+}
@@ -0,0 +1,26 @@
+
+#pragma once
+
+#include <Rcpp.h>
+
+#include <vector>
+
+//------------------------------------------------
+// quantiles over posterior draws of a logistic-transformed spline at each age.
+// nodes holds the node values of n_draws draws in column-major order, with one
+// column per node, as in an R matrix of draws by nodes. The spline of each
+// draw is obtained through the same fixed basis used within the MCMC, and is
+// transformed to scale/(1 + exp(-x)). Quantiles are calculated exactly, as by
+// R's quantile() with the default type 7. Ages are split over threads, each of
+// which holds the values of every draw at a single age, so that the full
+// matrix of draws by ages is never formed. On return ret holds one column of
+// age_vec.size() values per element of probs
+void spline_quantiles(const double *nodes, int n_draws, std::vector<double> &node_x,
+                      std::vector<double> &age_vec, double scale,
+                      const std::vector<double> &probs, int threads,
+                      std::vector<double> &ret);
+
+//------------------------------------------------
+// quantiles over posterior draws of a logistic-transformed spline at each age
+// [[Rcpp::export]]
+Rcpp::List spline_quantiles_cpp(Rcpp::List args);
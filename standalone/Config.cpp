@@ -0,0 +1,214 @@
+
+#include "Config.h"
+
+#include <stdlib.h>
+#include <math.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+//------------------------------------------------
+// read all keys and values
+Config::Config(const string &path) {
+  this->path = path;
+  ifstream stream(path);
+  if (!stream) {
+    throw runtime_error("could not open input file " + path);
+  }
+  string line;
+  while (getline(stream, line)) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    istringstream line_stream(line);
+    string key;
+    if (!(line_stream >> key) || (key[0] == '#')) {
+      continue;
+    }
+    vector<string> x;
+    string value;
+    while (line_stream >> value) {
+      x.push_back(value);
+    }
+    size_t start = line.find_first_not_of(" \t", line.find(key) + key.size());
+    values[key] = x;
+    text[key] = (start == string::npos) ? "" : line.substr(start);
+  }
+}
+
+//------------------------------------------------
+// get all values of a key
+const vector<string> & Config::get(const string &key) const {
+  map<string, vector<string>>::const_iterator it = values.find(key);
+  if (it == values.end()) {
+    throw runtime_error("input file " + path + " has no value for " + key);
+  }
+  return it->second;
+}
+
+//------------------------------------------------
+// get the single value of a key
+const string & Config::get_single(const string &key) const {
+  const vector<string> &x = get(key);
+  if (x.size() != 1) {
+    throw runtime_error("input file " + path + " must have a single value for " + key);
+  }
+  return x[0];
+}
+
+//------------------------------------------------
+// parse values. Integers can be written in any form that is a whole number
+bool Config::parse_bool(const string &key, const string &x) const {
+  if ((x == "1") || (x == "TRUE") || (x == "true")) {
+    return true;
+  }
+  if ((x == "0") || (x == "FALSE") || (x == "false")) {
+    return false;
+  }
+  throw runtime_error("input file " + path + " has invalid logical value " + x + " for " + key);
+}
+int Config::parse_int(const string &key, const string &x) const {
+  double ret = parse_double(key, x);
+  if ((ret != floor(ret)) || (fabs(ret) > 2147483647.0)) {
+    throw runtime_error("input file " + path + " has invalid integer value " + x + " for " + key);
+  }
+  return int(ret);
+}
+double Config::parse_double(const string &key, const string &x) const {
+  char *end;
+  double ret = strtod(x.c_str(), &end);
+  if ((end == x.c_str()) || (*end != '\0')) {
+    throw runtime_error("input file " + path + " has invalid numeric value " + x + " for " + key);
+  }
+  return ret;
+}
+
+//------------------------------------------------
+// get single values
+bool Config::get_bool(const string &key) const {
+  return parse_bool(key, get_single(key));
+}
+int Config::get_int(const string &key) const {
+  return parse_int(key, get_single(key));
+}
+double Config::get_double(const string &key) const {
+  return parse_double(key, get_single(key));
+}
+string Config::get_string(const string &key) const {
+  get(key);
+  return text.at(key);
+}
+
+//------------------------------------------------
+// get vectors of values
+vector<bool> Config::get_vector_bool(const string &key) const {
+  const vector<string> &x = get(key);
+  vector<bool> ret(x.size());
+  for (unsigned int i = 0; i < x.size(); ++i) {
+    ret[i] = parse_bool(key, x[i]);
+  }
+  return ret;
+}
+vector<int> Config::get_vector_int(const string &key) const {
+  const vector<string> &x = get(key);
+  vector<int> ret(x.size());
+  for (unsigned int i = 0; i < x.size(); ++i) {
+    ret[i] = parse_int(key, x[i]);
+  }
+  return ret;
+}
+vector<double> Config::get_vector_double(const string &key) const {
+  const vector<string> &x = get(key);
+  vector<double> ret(x.size());
+  for (unsigned int i = 0; i < x.size(); ++i) {
+    ret[i] = parse_double(key, x[i]);
+  }
+  return ret;
+}
+
+//------------------------------------------------
+// read the same inputs as System::load()
+void load_system(System &s, const Config &config, LookupSpec &lookup_spec,
+                 vector<vector<int>> &m_count) {
+  
+  // misc data
+  s.max_indlevel_age = config.get_int("data_list.max_indlevel_age");
+  
+  // age splines
+  s.node_x = config.get_vector_double("data_list.node_x");
+  
+  // individual-level data
+  string p = "data_list.indlevel.";
+  s.p_numer = {config.get_vector_int(p + "p_AI_numer"),
+               config.get_vector_int(p + "p_AD_numer"),
+               config.get_vector_int(p + "p_ID_numer"),
+               config.get_vector_int(p + "p_SD_numer")};
+  s.p_denom = {config.get_vector_int(p + "p_AI_denom"),
+               config.get_vector_int(p + "p_AD_denom"),
+               config.get_vector_int(p + "p_ID_denom"),
+               config.get_vector_int(p + "p_SD_denom")};
+  m_count = {config.get_vector_int(p + "m_AI_count"),
+             config.get_vector_int(p + "m_AD_count"),
+             config.get_vector_int(p + "m_AC_count"),
+             config.get_vector_int(p + "m_ID_count"),
+             config.get_vector_int(p + "m_I1S_count"),
+             config.get_vector_int(p + "m_I2S_count"),
+             config.get_vector_int(p + "m_SD_count"),
+             config.get_vector_int(p + "m_SC_count")};
+  
+  // model parameters
+  s.theta_min = config.get_vector_double("theta_min");
+  s.theta_max = config.get_vector_double("theta_max");
+  s.theta_init = config.get_vector_double("theta_init");
+  s.trans_type = config.get_vector_int("trans_type");
+  s.skip_param = config.get_vector_bool("skip_param");
+  
+  // proposal blocks
+  s.block_update = config.get_bool("block_update");
+  s.full_block = config.get_bool("full_block");
+  s.hmc_update = config.get_bool("hmc_update");
+  s.hmc_steps = config.get_int("hmc_steps");
+  s.delayed_accept = config.get_vector_bool("delayed_accept");
+  s.screen_stride = config.get_int("screen_stride");
+  
+  // MCMC parameters
+  s.burnin = config.get_int("burnin");
+  s.samples = config.get_int("samples");
+  s.converge_test = config.get_bool("converge_test");
+  s.converge_interval = config.get_int("converge_interval");
+  s.converge_alpha = config.get_double("converge_alpha");
+  s.beta_vec = config.get_vector_double("beta_vec");
+  s.adapt_beta = config.get_bool("adapt_beta");
+  
+  // output storage
+  s.thin = config.get_int("thin");
+  s.store_rungs = config.get_vector_int("store_rungs");
+  s.chains = config.get_int("chains");
+  s.threads = config.get_int("threads");
+  s.parallel_rungs = config.get_bool("parallel_rungs");
+  s.seed = config.get_int("seed");
+  
+  // checkpointing
+  s.checkpoint_file = config.get_string("checkpoint_file");
+  s.checkpoint_interval = config.get_int("checkpoint_interval");
+  s.resume = config.get_bool("resume");
+  
+  // streamed output
+  s.output_file = config.get_string("output_file");
+  s.output_precision = config.get_int("output_precision");
+  
+  // misc parameters
+  s.pb_markdown = config.get_bool("pb_markdown");
+  s.silent = config.get_bool("silent");
+  
+  // lookup table specification
+  lookup_spec.m_max = config.get_double("lookup.m_max");
+  lookup_spec.m_step = config.get_double("lookup.m_step");
+  lookup_spec.n_s = config.get_int("lookup.n_shape");
+  lookup_spec.x_max = config.get_int("lookup.x_max");
+  lookup_spec.interp_m = config.get_bool("lookup.interp_m");
+  lookup_spec.interp_s = config.get_bool("lookup.interp_s");
+  
+}
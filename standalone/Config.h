@@ -0,0 +1,62 @@
+
+#pragma once
+
+#include "System.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+//------------------------------------------------
+// class for reading the input file of a standalone run, as written from R by
+// write_mcmc_input(). Each line holds a key followed by its values separated
+// by whitespace, and keys of nested lists are joined with ".", for example
+// "data_list.indlevel.p_AI_numer". Strings are given by the remainder of the
+// line, and so can contain spaces. Blank lines and lines starting with "#" are
+// ignored. Errors are thrown as std::runtime_error
+class Config {
+  
+public:
+  // PUBLIC OBJECTS
+  
+  std::string path;
+  
+  // values of each key, and the complete remainder of each line
+  std::map<std::string, std::vector<std::string>> values;
+  std::map<std::string, std::string> text;
+  
+  
+  // PUBLIC FUNCTIONS
+  
+  // constructors
+  Config(const std::string &path);
+  
+  bool has(const std::string &key) const {
+    return values.count(key) > 0;
+  }
+  
+  // get values, throwing if the key is missing or values are malformed
+  const std::vector<std::string> & get(const std::string &key) const;
+  bool get_bool(const std::string &key) const;
+  int get_int(const std::string &key) const;
+  double get_double(const std::string &key) const;
+  std::string get_string(const std::string &key) const;
+  std::vector<bool> get_vector_bool(const std::string &key) const;
+  std::vector<int> get_vector_int(const std::string &key) const;
+  std::vector<double> get_vector_double(const std::string &key) const;
+  
+private:
+  bool parse_bool(const std::string &key, const std::string &x) const;
+  int parse_int(const std::string &key, const std::string &x) const;
+  double parse_double(const std::string &key, const std::string &x) const;
+  const std::string & get_single(const std::string &key) const;
+  
+};
+
+//------------------------------------------------
+// read the same inputs as System::load() from an input file, but do not call
+// System::setup(), so that settings can still be overridden from the command
+// line. The lookup table specification is returned in lookup_spec, and the
+// duration histograms in m_count
+void load_system(System &s, const Config &config, LookupSpec &lookup_spec,
+                 std::vector<std::vector<int>> &m_count);
@@ -0,0 +1,117 @@
+
+#ifdef MARKOVID_MPI
+
+#include "MpiRungGroup.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+//------------------------------------------------
+// split particles into contiguous blocks over processes
+MpiRungGroup::MpiRungGroup(MPI_Comm comm, int rungs) {
+  this->comm = comm;
+  this->rungs = rungs;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+  if (size > rungs) {
+    throw runtime_error("cannot split " + to_string(rungs) + " rungs over " +
+                        to_string(size) + " processes");
+  }
+  owner = vector<int>(rungs);
+  first = vector<int>(size + 1);
+  for (int q = 0; q <= size; ++q) {
+    first[q] = q*rungs / size;
+  }
+  for (int q = 0; q < size; ++q) {
+    for (int r = first[q]; r < first[q+1]; ++r) {
+      owner[r] = q;
+    }
+  }
+  counts = vector<int>(size);
+  displs = vector<int>(size);
+}
+
+//------------------------------------------------
+// share loglikelihoods of all particles, and the complete state of shared
+// particles. Each process sends the loglikelihoods of its own particles,
+// followed by the state of each shared particle it owns, in the order of
+// shared, and finally its interrupt flag. Every process knows which particles
+// are shared and who owns them, and so can work out the layout of the
+// gathered buffer without further communication
+void MpiRungGroup::share(vector<Particle> &particle_vec, const vector<int> &shared,
+                         bool &interrupted) {
+  
+  // size of the block sent by each process
+  int d = int(particle_vec[0].theta.size());
+  int n_state = d + 3;
+  int n_total = 0;
+  for (int q = 0; q < size; ++q) {
+    counts[q] = first[q+1] - first[q] + 1;
+    for (int r : shared) {
+      if (owner[r] == q) {
+        counts[q] += n_state;
+      }
+    }
+    displs[q] = n_total;
+    n_total += counts[q];
+  }
+  send_buffer.resize(counts[rank]);
+  recv_buffer.resize(n_total);
+  
+  // pack loglikelihoods, the state of shared local particles and the
+  // interrupt flag
+  int k = 0;
+  for (int r = first[rank]; r < first[rank+1]; ++r) {
+    send_buffer[k++] = particle_vec[r].loglike;
+  }
+  for (int r : shared) {
+    if (is_local(r)) {
+      const Particle &p = particle_vec[r];
+      send_buffer[k++] = p.loglike;
+      send_buffer[k++] = p.logprior;
+      send_buffer[k++] = p.accept_count;
+      for (int i = 0; i < d; ++i) {
+        send_buffer[k++] = p.theta[i];
+      }
+    }
+  }
+  send_buffer[k] = interrupted ? 1.0 : 0.0;
+  
+  // gather in a single collective call
+  MPI_Allgatherv(send_buffer.data(), counts[rank], MPI_DOUBLE, recv_buffer.data(),
+                 counts.data(), displs.data(), MPI_DOUBLE, comm);
+  
+  // unpack the gathered blocks, leaving the state of local particles as it is
+  interrupted = false;
+  for (int q = 0; q < size; ++q) {
+    k = displs[q];
+    for (int r = first[q]; r < first[q+1]; ++r) {
+      particle_vec[r].loglike = recv_buffer[k++];
+    }
+    for (int r : shared) {
+      if (owner[r] == q) {
+        if (q != rank) {
+          Particle &p = particle_vec[r];
+          p.loglike = recv_buffer[k];
+          p.logprior = recv_buffer[k + 1];
+          p.accept_count = int(recv_buffer[k + 2]);
+          for (int i = 0; i < d; ++i) {
+            p.theta[i] = recv_buffer[k + 3 + i];
+          }
+        }
+        k += n_state;
+      }
+    }
+    interrupted = interrupted || (recv_buffer[k] != 0);
+  }
+  
+}
+
+//------------------------------------------------
+// elementwise sum over all processes
+void MpiRungGroup::sum(vector<int> &x) {
+  MPI_Allreduce(MPI_IN_PLACE, x.data(), int(x.size()), MPI_INT, MPI_SUM, comm);
+}
+
+#endif
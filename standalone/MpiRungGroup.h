@@ -0,0 +1,57 @@
+
+#pragma once
+
+#ifdef MARKOVID_MPI
+
+#include "RungGroup.h"
+
+#include <mpi.h>
+
+#include <vector>
+
+//------------------------------------------------
+// rungs of a chain spread over the processes of an MPI communicator. Each
+// process owns a contiguous block of particles, and so must hold at least one
+// of them. Sharing takes a single collective call per iteration, which
+// gathers the loglikelihoods of all particles, the complete state of shared
+// particles and the interrupt flag of every process
+class MpiRungGroup : public RungGroup {
+  
+public:
+  // PUBLIC OBJECTS
+  
+  MPI_Comm comm;
+  int rank;
+  int size;
+  int rungs;
+  
+  // owning process of each particle, and the first particle owned by each
+  // process
+  std::vector<int> owner;
+  std::vector<int> first;
+  
+  // scratch space for communication
+  std::vector<int> counts;
+  std::vector<int> displs;
+  std::vector<double> send_buffer;
+  std::vector<double> recv_buffer;
+  
+  
+  // PUBLIC FUNCTIONS
+  
+  // constructors
+  MpiRungGroup(MPI_Comm comm, int rungs);
+  
+  bool is_local(int r) const {
+    return owner[r] == rank;
+  }
+  bool is_root() const {
+    return rank == 0;
+  }
+  void share(std::vector<Particle> &particle_vec, const std::vector<int> &shared,
+             bool &interrupted);
+  void sum(std::vector<int> &x);
+  
+};
+
+#endif
@@ -0,0 +1,439 @@
+
+// Standalone command-line build of the sampler, for running without R, for
+// example as the tasks of a job array on a cluster. Reads the input file
+// written by write_mcmc_input(), runs the same engine as run_mcmc(), and
+// streams stored samples to the same binary output files, which can be read
+// back from R with read_mcmc_samples(). Chains are numbered as in run_mcmc()
+// and each chain draws from the same random number stream, so running chain k
+// of a given input here gives exactly the same samples as chain k of the
+// equivalent call to run_mcmc().
+//
+// usage: markovid_mcmc [options] input_file
+//
+// options:
+//   --chain k              run only chain k, which can be given more than once
+//   --threads n            number of threads
+//   --seed x               seed of the random number generator
+//   --output-file path     path prefix of output files
+//   --checkpoint-file path path prefix of checkpoint files
+//   --resume               continue from checkpoint files where they exist
+//   --silent               suppress console output
+//   --rung-ranks n         (MPI builds only) number of processes per chain
+//
+// When built with MPI support ("make MPI=1", giving markovid_mcmc_mpi) and
+// launched with mpirun, processes are split into groups of rung-ranks
+// processes, and chains are dealt out over the groups in turn. Within a group
+// the rungs of each chain are split between processes, which exchange only the
+// loglikelihoods needed for Metropolis coupling along with the state of stored
+// rungs (see RungGroup.h), and the first process of the group writes the
+// chain's output file. Samples are the same however the run is split. When
+// rungs are split, checkpoint files are written per process, with "_rank<i>"
+// appended to the path prefix.
+//
+// SIGINT and SIGTERM, as sent by most schedulers before a job is killed, stop
+// all chains at the end of their current iteration, writing a checkpoint if
+// checkpoint files are in use. The exit status is 0 on success, 1 on error and
+// 130 on interrupt.
+
+#include "Config.h"
+#include "System.h"
+#include "Chain.h"
+#include "Progress.h"
+#include "run_tasks.h"
+#include "misc_v10.h"
+
+#ifdef MARKOVID_MPI
+#include "MpiRungGroup.h"
+#include <mpi.h>
+#endif
+
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+//------------------------------------------------
+// class holding everything needed to run a subset of the chains of a single
+// MCMC, with output always streamed to file. chain_number gives the
+// (one-based) number of each chain that is run
+class StandaloneRun {
+  
+public:
+  // PUBLIC OBJECTS
+  
+  // system object, and one copy per chain
+  System s;
+  std::vector<System> s_vec;
+  
+  // chains, and output buffers per chain
+  std::vector<Chain> chain_vec;
+  std::vector<std::vector<double>> stream_buffer;
+  
+  
+  // PUBLIC FUNCTIONS
+  
+  // constructors. Objects must not be copied once chains are initialised
+  StandaloneRun(const System &s, const std::vector<int> &chain_number);
+  
+  // initialise chain c, continuing from its checkpoint if resuming
+  bool init_chain(int c);
+  
+};
+
+//------------------------------------------------
+// allocate output buffers of output_block_rows rows per stored rung, which are
+// emptied to disk as they fill up
+StandaloneRun::StandaloneRun(const System &s, const vector<int> &chain_number) {
+  this->s = s;
+  int n_chain = int(chain_number.size());
+  s_vec = vector<System>(n_chain, s);
+  int n_buffer = int(s.store_rungs.size())*s.output_block_rows;
+  stream_buffer = vector<vector<double>>(n_chain, vector<double>((s.d + 2)*n_buffer));
+  for (int c = 0; c < n_chain; ++c) {
+    s_vec[c].chain = chain_number[c];
+  }
+  chain_vec = vector<Chain>(n_chain);
+}
+
+//------------------------------------------------
+// initialise chain c, continuing from its checkpoint if resuming. Returns true
+// if the chain was resumed
+bool StandaloneRun::init_chain(int c) {
+  int n_buffer = int(s.store_rungs.size())*s.output_block_rows;
+  double *buffer = stream_buffer[c].data();
+  vector<double *> theta_out(s.d);
+  for (int i = 0; i < s.d; ++i) {
+    theta_out[i] = buffer + (i + 2)*n_buffer;
+  }
+  chain_vec[c].init(s_vec[c], buffer, buffer + n_buffer, theta_out);
+  return s.resume && chain_vec[c].load_checkpoint();
+}
+
+//------------------------------------------------
+// run chains one at a time, with the rungs of each chain split over the
+// processes of a group. Every process of the group runs every chain, stopping
+// at the same iteration on interrupt, and any error aborts the whole run as
+// the other processes cannot continue without it. Returns true if interrupted
+#ifdef MARKOVID_MPI
+static bool run_split_chains(StandaloneRun &run, MpiRungGroup &group, bool draw_bar,
+                             bool markdown, vector<char> &resumed) {
+  
+  int n_chain = int(run.chain_vec.size());
+  Progress progress(vector<int>(n_chain, run.s.burnin + run.s.samples), draw_bar, markdown);
+  resumed = vector<char>(n_chain);
+  for (int c = 0; c < n_chain; ++c) {
+    Chain &chain = run.chain_vec[c];
+    chain.group = &group;
+    resumed[c] = run.init_chain(c);
+    
+    // every process must continue from the same point
+    int n_resumed = resumed[c];
+    int n_resumed_all;
+    MPI_Allreduce(&n_resumed, &n_resumed_all, 1, MPI_INT, MPI_SUM, group.comm);
+    if ((n_resumed_all != 0) && (n_resumed_all != group.size)) {
+      throw runtime_error("checkpoint files of chain " + to_string(run.s_vec[c].chain) +
+                          " are missing for some processes");
+    }
+    
+    int burnin_done = (chain.burnin_done == chain.burnin_end) ? run.s.burnin : chain.burnin_done;
+    progress.update(c, burnin_done + chain.sampling_done);
+    chain.run_burnin(&progress, c);
+    if (chain.burnin_done == chain.burnin_end) {
+      chain.run_sampling(&progress, c);
+    }
+    progress.finish(c);
+    if (chain.sampling_done < run.s.samples) {
+      return true;
+    }
+  }
+  return false;
+}
+#endif
+
+//------------------------------------------------
+// print usage and throw
+static void usage() {
+  cerr << "usage: markovid_mcmc [--chain k] [--threads n] [--seed x] [--output-file path]\n"
+       << "                     [--checkpoint-file path] [--resume] [--silent]\n"
+#ifdef MARKOVID_MPI
+       << "                     [--rung-ranks n]\n"
+#endif
+       << "                     input_file\n";
+  throw runtime_error("invalid command line arguments");
+}
+
+//------------------------------------------------
+// parse a whole number from the command line
+static int parse_arg_int(const string &name, const char *x) {
+  char *end;
+  long ret = strtol(x, &end, 10);
+  if ((end == x) || (*end != '\0') || (ret < 0) || (ret > 2147483647L)) {
+    throw runtime_error("invalid value " + string(x) + " for " + name);
+  }
+  return int(ret);
+}
+
+//------------------------------------------------
+// read inputs, apply command-line overrides and run the requested chains
+static int run(int argc, char **argv) {
+  
+  // start timer
+  chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+  
+  // parse command line
+  string input_file;
+  vector<int> chain_number;
+  int threads = -1;
+  int seed = -1;
+  bool set_output_file = false;
+  bool set_checkpoint_file = false;
+  string output_file, checkpoint_file;
+  bool resume = false;
+  bool silent = false;
+  int rung_ranks = 1;
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    bool has_value = (i + 1 < argc);
+    if ((arg == "--chain") && has_value) {
+      chain_number.push_back(parse_arg_int(arg, argv[++i]));
+    } else if ((arg == "--threads") && has_value) {
+      threads = parse_arg_int(arg, argv[++i]);
+    } else if ((arg == "--seed") && has_value) {
+      seed = parse_arg_int(arg, argv[++i]);
+    } else if ((arg == "--output-file") && has_value) {
+      output_file = argv[++i];
+      set_output_file = true;
+    } else if ((arg == "--checkpoint-file") && has_value) {
+      checkpoint_file = argv[++i];
+      set_checkpoint_file = true;
+    } else if (arg == "--resume") {
+      resume = true;
+    } else if (arg == "--silent") {
+      silent = true;
+#ifdef MARKOVID_MPI
+    } else if ((arg == "--rung-ranks") && has_value) {
+      rung_ranks = parse_arg_int(arg, argv[++i]);
+#endif
+    } else if ((arg[0] != '-') && input_file.empty()) {
+      input_file = arg;
+    } else {
+      usage();
+    }
+  }
+  if (input_file.empty()) {
+    usage();
+  }
+  
+  // read inputs and apply overrides
+  System s;
+  LookupSpec lookup_spec;
+  vector<vector<int>> m_count;
+  load_system(s, Config(input_file), lookup_spec, m_count);
+  if (threads > 0) {
+    s.threads = threads;
+  }
+  if (seed >= 0) {
+    s.seed = seed;
+  }
+  if (set_output_file) {
+    s.output_file = output_file;
+  }
+  if (set_checkpoint_file) {
+    s.checkpoint_file = checkpoint_file;
+  }
+  s.resume = s.resume || resume;
+  s.silent = s.silent || silent;
+  if (s.output_file.empty()) {
+    throw runtime_error("an output file must be given, either in the input file or with --output-file");
+  }
+  if (s.resume && s.checkpoint_file.empty()) {
+    throw runtime_error("a checkpoint file must be given when resuming");
+  }
+  
+  // run all chains unless told otherwise. Threads are split between the chains
+  // that are actually run
+  if (chain_number.empty()) {
+    for (int c = 0; c < s.chains; ++c) {
+      chain_number.push_back(c + 1);
+    }
+  }
+  for (int k : chain_number) {
+    if ((k < 1) || (k > s.chains)) {
+      throw runtime_error("chain " + to_string(k) + " is out of range, as the input has " +
+                          to_string(s.chains) + " chains");
+    }
+  }
+  
+  // processes are split into groups of rung_ranks, and chains are dealt out
+  // over the groups in turn. Without MPI there is a single group made up of a
+  // single process
+  int world_rank = 0;
+  int group_rank = 0;
+#ifdef MARKOVID_MPI
+  int world_size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+  if ((rung_ranks < 1) || ((world_size % rung_ranks) != 0)) {
+    throw runtime_error("the number of processes must be a multiple of --rung-ranks");
+  }
+  int n_group = world_size / rung_ranks;
+  int group_index = world_rank / rung_ranks;
+  group_rank = world_rank % rung_ranks;
+  MPI_Comm group_comm;
+  MPI_Comm_split(MPI_COMM_WORLD, group_index, world_rank, &group_comm);
+  vector<int> group_chain_number;
+  for (int i = group_index; i < int(chain_number.size()); i += n_group) {
+    group_chain_number.push_back(chain_number[i]);
+  }
+  chain_number = group_chain_number;
+  if (!s.silent && (world_rank == 0) && (world_size > 1)) {
+    print("running over", world_size, "processes, with", rung_ranks,
+          (rung_ranks == 1) ? "process per chain" : "processes per chain");
+  }
+#endif
+  int n_chain = int(chain_number.size());
+  if (n_chain == 0) {
+    return 0;
+  }
+  
+  // when rungs are split, chains are run one at a time with all threads going
+  // to rungs
+  bool split_rungs = (rung_ranks > 1);
+  s.chains = split_rungs ? 1 : n_chain;
+  s.setup(m_count, lookup_spec);
+  
+  // only the first process of each group reports and writes output, and the
+  // progress bar is only drawn by the very first process
+  bool report = !s.silent && (group_rank == 0);
+  bool draw_bar = !s.silent && (world_rank == 0);
+#ifdef MARKOVID_MPI
+  unique_ptr<MpiRungGroup> group;
+  if (split_rungs) {
+    group = unique_ptr<MpiRungGroup>(new MpiRungGroup(group_comm, s.rungs));
+    if (!s.checkpoint_file.empty()) {
+      s.checkpoint_file += "_rank" + to_string(group_rank);
+    }
+  }
+#endif
+  StandaloneRun run(s, chain_number);
+  
+  // rungs are parallelised within chains, which may themselves be running in
+  // parallel
+#ifdef _OPENMP
+  if (s.rung_threads > 1) {
+    omp_set_max_active_levels(2);
+  }
+#endif
+  
+  // run chains
+  if (report) {
+    print("running", n_chain, (n_chain == 1) ? "chain on" : "chains on",
+          s.chain_threads*s.rung_threads, (s.chain_threads*s.rung_threads == 1) ? "thread" : "threads");
+  }
+  catch_interrupt_signals();
+  vector<string> error_message(n_chain);
+  vector<char> resumed;
+  bool interrupted = false;
+  if (split_rungs) {
+#ifdef MARKOVID_MPI
+    interrupted = run_split_chains(run, *group, draw_bar, s.pb_markdown, resumed);
+#endif
+  } else {
+    vector<StandaloneRun *> run_vec = {&run};
+    vector<pair<int, int>> task_vec;
+    for (int c = 0; c < n_chain; ++c) {
+      task_vec.push_back(make_pair(0, c));
+    }
+    interrupted = run_chain_tasks(run_vec, task_vec, s.chain_threads, draw_bar,
+                                  s.pb_markdown, error_message, resumed);
+  }
+  
+  bool failed = false;
+  for (int c = 0; c < n_chain; ++c) {
+    if (!error_message[c].empty()) {
+      cerr << "error in chain " << chain_number[c] << ": " << error_message[c] << "\n";
+      failed = true;
+    }
+  }
+  if (failed) {
+    return 1;
+  }
+  if (interrupted) {
+    if (report) {
+      print("interrupted");
+      if (!s.checkpoint_file.empty()) {
+        print("chains can be resumed from their last checkpoint");
+      }
+    }
+    return 130;
+  }
+  
+  // print phase diagnostics, along with the final temperature ladder
+  if (report) {
+    for (int c = 0; c < n_chain; ++c) {
+      Chain &chain = run.chain_vec[c];
+      int k = chain_number[c];
+      if (resumed[c]) {
+        print("chain", k, "resumed from", chain.get_checkpoint_path());
+      }
+      if (chain.burnin_end < s.burnin) {
+        print("chain", k, "converged after", chain.burnin_end, "burn-in iterations");
+      }
+      cout << "chain " << k << " acceptance rate: burn-in "
+           << round(chain.accept_rate_burnin*1000) / 10.0 << "%, sampling "
+           << round(chain.accept_rate_sampling*1000) / 10.0 << "%\n";
+      for (int r = 0; r < s.rungs; ++r) {
+        if (s.delayed_accept[r]) {
+          cout << "chain " << k << " rung " << (r + 1) << " screen pass rate: burn-in "
+               << round(chain.screen_pass_burnin[r]*1000) / 10.0 << "%, sampling "
+               << round(chain.screen_pass_sampling[r]*1000) / 10.0 << "%, estimated speedup "
+               << round(chain.screen_speedup_sampling[r]*100) / 100.0 << "x\n";
+        }
+      }
+      if (s.rungs > 1) {
+        cout << "chain " << k << " beta_vec: ";
+        print_vector(chain.get_beta_ladder());
+        double log_ml, log_ml_se;
+        chain.get_marginal_likelihood(log_ml, log_ml_se);
+        cout << "chain " << k << " log marginal likelihood: " << log_ml
+             << " (standard error " << log_ml_se << ")\n";
+      }
+      print("chain", k, "output written to", chain.get_output_path());
+    }
+    print("");
+    chrono_timer(t1);
+  }
+  
+  return 0;
+}
+
+//------------------------------------------------
+int main(int argc, char **argv) {
+#ifdef MARKOVID_MPI
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+#endif
+  int ret;
+  try {
+    ret = run(argc, argv);
+  } catch (std::exception &e) {
+    cerr << "error: " << e.what() << "\n";
+#ifdef MARKOVID_MPI
+    MPI_Abort(MPI_COMM_WORLD, 1);
+#endif
+    ret = 1;
+  }
+#ifdef MARKOVID_MPI
+  MPI_Finalize();
+#endif
+  return ret;
+}